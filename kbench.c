@@ -0,0 +1,149 @@
+//Author: Tu Le
+//CS4760 Project 5
+//Safety kernel benchmark: times the int, runtime-shape packed and unrolled kernels on one shape.
+//The shape is fixed when building, e.g. make kbench_18x5 (see the bench target in the Makefile).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "kernels.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef BENCH_PROCESSES
+#define BENCH_PROCESSES 18
+#endif
+#ifndef BENCH_RESOURCES
+#define BENCH_RESOURCES 5
+#endif
+#define BENCH_INSTANCES 10
+#define BENCH_STATES 4096
+#define BENCH_PASSES 200
+
+typedef struct {
+	int available[BENCH_RESOURCES];
+	int need[BENCH_PROCESSES * BENCH_RESOURCES];
+	int give[BENCH_PROCESSES * BENCH_RESOURCES];
+	uint64_t packedWork;
+	uint64_t packedNeed[BENCH_PROCESSES];
+	uint64_t packedGive[BENCH_PROCESSES];
+	uint32_t live;
+} BenchState;
+
+BenchState states[BENCH_STATES];
+
+//Deal every instance out to random live processes or leave it available, then give each process a
+//random remaining claim; roughly the mix of safe and unsafe states a loaded oss sees
+void make_state(BenchState *st) {
+	st->live = 0;
+	for (int i = 0; i < BENCH_PROCESSES; i++) {
+		if (rand() % 5 != 0) st->live |= (uint32_t)1 << i;
+	}
+	if (st->live == 0) st->live = 1;
+	for (int i = 0; i < BENCH_PROCESSES * BENCH_RESOURCES; i++) {
+		st->give[i] = 0;
+		st->need[i] = 0;
+	}
+	for (int j = 0; j < BENCH_RESOURCES; j++) {
+		st->available[j] = 0;
+		for (int n = 0; n < BENCH_INSTANCES; n++) {
+			int i = rand() % BENCH_PROCESSES;
+			if ((st->live >> i & 1) && rand() % 3 != 0) {
+				st->give[i * BENCH_RESOURCES + j]++;
+			} else {
+				st->available[j]++;
+			}
+		}
+	}
+	for (int i = 0; i < BENCH_PROCESSES; i++) {
+		if (!(st->live >> i & 1)) continue;
+		for (int j = 0; j < BENCH_RESOURCES; j++) {
+			int room = BENCH_INSTANCES - st->give[i * BENCH_RESOURCES + j];
+			st->need[i * BENCH_RESOURCES + j] = rand() % (room < 6 ? room + 1 : 6);
+		}
+	}
+	st->packedWork = pack_lanes(st->available, BENCH_RESOURCES);
+	for (int i = 0; i < BENCH_PROCESSES; i++) {
+		st->packedNeed[i] = pack_lanes(&st->need[i * BENCH_RESOURCES], BENCH_RESOURCES);
+		st->packedGive[i] = pack_lanes(&st->give[i * BENCH_RESOURCES], BENCH_RESOURCES);
+	}
+}
+
+uint32_t run_int(const BenchState *st) {
+	int work[BENCH_RESOURCES];
+	memcpy(work, st->available, sizeof(work));
+	return safety_kernel_int(BENCH_PROCESSES, BENCH_RESOURCES, work, st->need, st->give, st->live);
+}
+
+uint32_t run_packed(const BenchState *st) {
+	return safety_kernel_packed(BENCH_PROCESSES, BENCH_RESOURCES, st->packedWork, st->packedNeed, st->packedGive, st->live);
+}
+
+const SafetyKernel *unrolled;
+
+uint32_t run_unrolled(const BenchState *st) {
+	return unrolled->fn(st->packedWork, st->packedNeed, st->packedGive, st->live);
+}
+
+uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//Time one kernel over every state, BENCH_PASSES times
+void bench(const char *name, uint32_t (*run)(const BenchState *)) {
+	volatile uint32_t sink = 0;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint64_t startCycles = read_cycles();
+	for (int pass = 0; pass < BENCH_PASSES; pass++) {
+		for (int s = 0; s < BENCH_STATES; s++) {
+			sink ^= run(&states[s]);
+		}
+	}
+	uint64_t cycles = read_cycles() - startCycles;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double calls = (double)BENCH_PASSES * BENCH_STATES;
+	double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	printf("  %-16s %8.1f ns/check", name, ns / calls);
+	if (cycles) printf("  %8.1f cycles/check", cycles / calls);
+	printf("\n");
+}
+
+int main() {
+	if (!PACKED_SHAPE_FITS(BENCH_RESOURCES, BENCH_INSTANCES) || BENCH_PROCESSES > KERNEL_MAX_PROCESSES) {
+		fprintf(stderr, "kbench: %dx%d doesn't pack\n", BENCH_PROCESSES, BENCH_RESOURCES);
+		return 1;
+	}
+	srand(4760);
+	int safe = 0;
+	for (int s = 0; s < BENCH_STATES; s++) {
+		make_state(&states[s]);
+	}
+
+	unrolled = find_safety_kernel(BENCH_PROCESSES, BENCH_RESOURCES);
+	//Every kernel must agree with the int one before any of them is timed
+	for (int s = 0; s < BENCH_STATES; s++) {
+		uint32_t expect = run_int(&states[s]);
+		if (run_packed(&states[s]) != expect || (unrolled && run_unrolled(&states[s]) != expect)) {
+			fprintf(stderr, "kbench: kernels disagree on state %d\n", s);
+			return 1;
+		}
+		if (expect == 0) safe++;
+	}
+
+	printf("Shape %dx%d (%d states, %.0f%% safe):\n", BENCH_PROCESSES, BENCH_RESOURCES, BENCH_STATES,
+			100.0 * safe / BENCH_STATES);
+	bench("int", run_int);
+	bench("packed", run_packed);
+	if (unrolled) {
+		bench(unrolled->name, run_unrolled);
+	} else {
+		printf("  no unrolled variant for this shape\n");
+	}
+	return 0;
+}
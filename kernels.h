@@ -0,0 +1,156 @@
+//Author: Tu Le
+//CS4760 Project 5
+//Banker's safe-sequence kernels, shared by oss and the kbench benchmark.
+//
+//Every kernel answers the same question: starting from work, which of the pending processes can't
+//finish? Process i can finish once need[i] fits in work, and then gives back give[i] (what it holds
+//plus anything being granted to it). A return of 0 means every pending process finishes: the state
+//is safe, or for deadlock detection, nothing is deadlocked.
+//
+//The packed kernels keep one resource per 8-bit lane of a uint64_t, so "need fits in work" for all
+//resources is one subtract and mask, and returning instances is one add. That needs at most 8
+//resources and at most 127 instances of each. The specialized variants fix the shape at compile time
+//so the process loop is fully unrolled and branch-free; the runtime-shape kernel is the fallback for
+//shapes without a variant, and safety_kernel_int works on plain int matrices of any shape.
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define KERNEL_LANE_BITS 8
+#define KERNEL_LANE_MAX 127 //largest value a lane holds without reaching the guard bit
+#define KERNEL_MAX_PROCESSES 32 //pending sets are uint32_t masks
+#define PACKED_SHAPE_FITS(resources, instances) ((resources) <= 8 && (instances) <= KERNEL_LANE_MAX)
+//Guard bit of every used lane
+#define KERNEL_HIGH_MASK(resources) (0x8080808080808080ULL >> (64 - KERNEL_LANE_BITS * (resources)))
+
+typedef uint32_t (*SafetyKernelFn)(uint64_t work, const uint64_t *need, const uint64_t *give, uint32_t pending);
+
+typedef struct {
+	const char *name;
+	int processes;
+	int resources;
+	SafetyKernelFn fn;
+} SafetyKernel;
+
+static inline uint64_t lane_set(uint64_t packed, int j, int value) {
+	if (value > KERNEL_LANE_MAX) value = KERNEL_LANE_MAX; //still never fits in a real work vector
+	if (value < 0) value = 0; //a negative need fits anything, just as 0 does
+	int shift = KERNEL_LANE_BITS * j;
+	return (packed & ~(0xFFULL << shift)) | ((uint64_t)value << shift);
+}
+
+static inline int lane_get(uint64_t packed, int j) {
+	return (int)((packed >> (KERNEL_LANE_BITS * j)) & 0xFF);
+}
+
+static inline uint64_t pack_lanes(const int *values, int resources) {
+	uint64_t packed = 0;
+	for (int j = 0; j < resources; j++) {
+		packed = lane_set(packed, j, values[j]);
+	}
+	return packed;
+}
+
+//Each lane of work | high is at least 0x80 and each lane of need at most 0x7F, so no lane borrows
+//from the next and the guard bit survives exactly where need <= work
+static inline bool lanes_fit(uint64_t need, uint64_t work, uint64_t high) {
+	return (((work | high) - need) & high) == high;
+}
+
+//Any shape that packs, with the shape given at run time
+static inline uint32_t safety_kernel_packed(int processes, int resources, uint64_t work,
+		const uint64_t *need, const uint64_t *give, uint32_t pending) {
+	const uint64_t high = KERNEL_HIGH_MASK(resources);
+	bool progress = true;
+	while (pending && progress) {
+		progress = false;
+		for (int i = 0; i < processes; i++) {
+			if ((pending >> i & 1) && lanes_fit(need[i], work, high)) {
+				work += give[i];
+				pending &= ~((uint32_t)1 << i);
+				progress = true;
+			}
+		}
+	}
+	return pending;
+}
+
+//Plain int matrices, row-major [processes][resources]; work is updated in place
+static inline uint32_t safety_kernel_int(int processes, int resources, int *work,
+		const int *need, const int *give, uint32_t pending) {
+	bool progress = true;
+	while (pending && progress) {
+		progress = false;
+		for (int i = 0; i < processes; i++) {
+			if (!(pending >> i & 1)) continue;
+			bool fits = true;
+			for (int j = 0; j < resources; j++) {
+				if (need[i * resources + j] > work[j]) {
+					fits = false;
+					break;
+				}
+			}
+			if (!fits) continue;
+			for (int j = 0; j < resources; j++) {
+				work[j] += give[i * resources + j];
+			}
+			pending &= ~((uint32_t)1 << i);
+			progress = true;
+		}
+	}
+	return pending;
+}
+
+//Each round tests every pending process against the same work vector, so the tests are independent and
+//the unrolled loop has no dependency chain through work; everything that fits is returned at once
+#define DEFINE_SAFETY_KERNEL(NP, NR) \
+static uint32_t safety_kernel_##NP##x##NR(uint64_t work, const uint64_t *need, const uint64_t *give, uint32_t pending) { \
+	const uint64_t high = KERNEL_HIGH_MASK(NR); \
+	uint32_t freed; \
+	do { \
+		uint64_t returned = 0; \
+		freed = 0; \
+		_Pragma("GCC unroll 32") \
+		for (int i = 0; i < (NP); i++) { \
+			uint64_t take = -(uint64_t)(lanes_fit(need[i], work, high) & (pending >> i & 1)); \
+			returned += give[i] & take; \
+			freed |= ((uint32_t)1 << i) & (uint32_t)take; \
+		} \
+		work += returned; \
+		pending &= ~freed; \
+	} while (pending && freed); \
+	return pending; \
+}
+
+//Shapes we run: the default 18 slots x 5 resources, and the sizes the benchmark compares
+DEFINE_SAFETY_KERNEL(8, 4)
+DEFINE_SAFETY_KERNEL(8, 5)
+DEFINE_SAFETY_KERNEL(18, 5)
+DEFINE_SAFETY_KERNEL(18, 8)
+DEFINE_SAFETY_KERNEL(32, 5)
+DEFINE_SAFETY_KERNEL(32, 8)
+
+static const SafetyKernel safetyKernels[] = {
+	{"unrolled-8x4", 8, 4, safety_kernel_8x4},
+	{"unrolled-8x5", 8, 5, safety_kernel_8x5},
+	{"unrolled-18x5", 18, 5, safety_kernel_18x5},
+	{"unrolled-18x8", 18, 8, safety_kernel_18x8},
+	{"unrolled-32x5", 32, 5, safety_kernel_32x5},
+	{"unrolled-32x8", 32, 8, safety_kernel_32x8},
+};
+#define SAFETY_KERNEL_COUNT ((int)(sizeof(safetyKernels) / sizeof(safetyKernels[0])))
+
+//The specialized variant for a shape, NULL if there isn't one
+static inline const SafetyKernel *find_safety_kernel(int processes, int resources) {
+	for (int k = 0; k < SAFETY_KERNEL_COUNT; k++) {
+		if (safetyKernels[k].processes == processes && safetyKernels[k].resources == resources) {
+			return &safetyKernels[k];
+		}
+	}
+	return NULL;
+}
+
+#endif
@@ -2,7 +2,9 @@
 //CS4760 Project 5
 //Date: 4/25/2025
 
+#define _GNU_SOURCE //sched_setaffinity and the CPU_* macros
 #include "shared.h" //Include the header
+#include "kernels.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,19 +16,30 @@
 #include <signal.h>
 #include <stdbool.h> //Include for bool type
 #include <sys/wait.h> //Include for waitpid()
+#include <sys/signalfd.h>
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <sched.h>
+#include <ctype.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <poll.h>
 
 //Constants (These could also be in a header file)
-#define MSGKEY 12345
 #define MAX_PROCESSES 18
-#define MAX_RUNTIME_SECONDS 3
 #define NUM_RESOURCES 5
 #define NUM_INSTANCES 10
 #define REQUEST_RESOURCE 1
 #define RELEASE_RESOURCE 2
 #define TERMINATE 3
+#define DEFAULT_MAX_CLAIM (NUM_INSTANCES / 2) //assumed per-resource claim until a worker declares its own
 #define LOG_LINE_LIMIT 10000
 #define DEFAULT_LAUNCH_INTERVAL_MS 100 //Default launch interval if not specified
 // Statistics tracking
@@ -36,19 +49,84 @@ int stat_deadlock_terminations = 0;
 int stat_normal_terminations = 0;
 int stat_deadlock_detection_runs = 0;
 int stat_deadlock_processes_terminated = 0;
+int stat_exits_deadlock_killed = 0; //reaped after a deadlock kill
+int stat_exits_crashed = 0; //died on a signal or a non-zero status without saying goodbye
+int stat_exits_unannounced = 0; //exited cleanly without sending TERMINATE
+int stat_exits_at_shutdown = 0; //still running when the simulation ended
+int stat_processes_launched = 0;
+int stat_claims_accepted = 0;
+int stat_claims_rejected = 0;
+int stat_legacy_claim_denials = 0; //grants the old fixed DEFAULT_MAX_CLAIM claims would have refused as unsafe
+int stat_preemptions = 0; //instances revoked to break deadlocks
+int stat_safety_checks = 0; //banker's isSafe evaluations for requests
+int stat_optimistic_grants = 0; //grants made without a safety check (detect/hybrid)
+int leaseSize = 0; //-L: instances leased per resource, 0 = leasing off
+int stat_lease_instances_issued = 0;
+int stat_lease_instances_revoked = 0;
+int stat_lease_reconciles = 0;
+bool leasesOutstanding = false;
+int stat_checkpoint_deferrals = 0; //ticks the checkpoint waited for the wait queue and outbox to empty
+int stat_workers_respawned = 0; //workers started in place of checkpointed processes
+int stat_control_commands = 0; //commands accepted on the control FIFO
+int federatedPartitions = 0; //-F: number of oss partitions, 0 = one oss owns every resource
+int partitionId = 0; //partition this process serves, the primary is 0
+int stat_federation_kills = 0; //victims of deadlocks found across partitions
+int stat_federation_rounds = 0; //detection rounds that heard from every partition
+int stat_federation_incomplete = 0; //rounds overtaken by the next before every snapshot arrived
+int pacingMode = PACING_WALL; //-t
+const char *pacingNames[] = {"wall", "sim", "ff"};
+int stat_pacing_wakeups = 0; //times oss woke workers whose simulated deadline had passed
+long long stat_fast_forward_ms = 0; //simulated ms skipped while every worker was asleep or blocked
+int stat_batches = 0; //loop iterations that had at least one request
+int stat_event_polls = 0; //poll calls over the signalfd, control FIFO and partition sockets
+int stat_event_polls_skipped = 0; //busy iterations that left the poll to a later one
+int stat_batched_requests = 0;
+int stat_max_batch = 0;
+int stat_batch_splits = 0; //request groups that failed a combined safety check and were halved
+long long stat_decision_wall_ns = 0; //wall time spent deciding new requests
+long long stat_legacy_wall_ns = 0; //wall time of the legacy-claims comparison, kept out of the decision time
+int stat_decisions = 0;
+int stat_admission_delays = 0; //launches held back by admission control, once each however long
+int stat_admission_rejects = 0; //launches dropped after waiting too long for admission
+int stat_admission_fast_launches = 0; //launches made early because the system was idle
+struct timespec run_start_wall; //wall clock at startup, for machine-readable stats
+char *statsfilename = NULL; //-o: write final statistics as JSON here
+char *workloadProfile = NULL; //-w: workload profile handed to every worker
 
 
 //Function prototypes
-int handleResourceRequest(int pid, int resourceId);
+int handleVectorRequest(int pid, const int *counts);
+void applyGrant(int processIndex, const int *counts);
 int send_message_to_worker(pid_t worker_pid, int status);
 void oss_log(const char *fmt, ...);
 void oss_log_verbose(const char *fmt, ...);
 void cleanup_shared_memory();
+void closeControlChannel();
+void federationSlotFreed(pid_t pid);
+void federationDetect();
+void stopPartitions();
+bool accountPartitionExit(pid_t pid, int status, bool shuttingDown);
+void revokeAllLeases();
+int revokeLeases(int i, const int *only);
+void lifeWaited(int i);
+void lifeUnblocked(int i, long long enqueueNs);
+void purgeRepliesTo(pid_t pid);
+void oracleGrant(int i, const int *counts);
+void oracleRelease(int i, const int *counts);
+void oracleReclaim(int i);
+void oracleClaim(int i, int j, int value);
+void oracleSlot(int i, pid_t pid);
+void oracleMove(int from, int to, int r);
+void oracleCheckDecision(int n, const int *slots, const int *counts, bool verdict);
+void oracleCheckDetection(const int *deadlocked, int deadlockedCount);
 
 //Global Variables
+SharedState *sharedState = NULL;
 SimulatedClock *simClock;
-int shmid;
-int msqid;
+int shmid = -1;
+int msqid = -1;
+unsigned int runId = 0; //namespaces this run's IPC objects (-r, defaults to oss pid)
+volatile sig_atomic_t ipc_cleaned = 0;
 ResourceDescriptor resourceTable[NUM_RESOURCES];
 PCB processTable[18];
 int available[NUM_RESOURCES]; //available resources
@@ -58,608 +136,4725 @@ int need[18][NUM_RESOURCES]; //remaining need of each process
 int verbose = 0;
 int log_line_count = 0;
 FILE *logfile = NULL;
+bool logMuted = false; //the fuzzer replays thousands of events; their log lines are noise
+bool oracleEnabled = false; //-D: the reference oracle checks every allocator event
+int stat_oracle_events = 0;
+int stat_oracle_decisions = 0;
+int stat_oracle_divergences = 0;
 
-// Add new global variables
-int maxProcesses = 18;  // Maximum number of processes
-int maxRuntimeSeconds = 15;  // Maximum runtime in seconds
-int launchIntervalMs = DEFAULT_LAUNCH_INTERVAL_MS;  // Launch interval in milliseconds
+//Deadlock handling strategy (-d)
+#define STRATEGY_AVOID 0 //banker's check on every request, no detection
+#define STRATEGY_DETECT 1 //grant whenever instances are free, detect and recover periodically
+#define STRATEGY_HYBRID 2 //grant optimistically below the utilization threshold, banker's above it, plus detection
+#define DEFAULT_HYBRID_THRESHOLD 50
+const char *strategyNames[] = {"avoid", "detect", "hybrid"};
+int deadlockStrategy = STRATEGY_AVOID;
+int hybridThresholdPct = DEFAULT_HYBRID_THRESHOLD; //-T: % of all instances allocated before banker's kicks in
 
+//Deadlock recovery (-R)
+#define RECOVERY_KILL 0 //terminate a deadlocked process and reclaim everything it holds
+#define RECOVERY_PREEMPT 1 //revoke single instances from a deadlocked process, keep it alive
+const char *recoveryNames[] = {"kill", "preempt"};
+int recoveryMode = RECOVERY_KILL; //-R: how a detected deadlock is broken
 
-//Wait queue for blocked resource requests
-#define MAX_WAIT_QUEUE 100
+//Safety verdict cache (-C)
+#define CACHE_OFF 0
+#define CACHE_ON 1
+#define CACHE_VERIFY 2 //look up as usual, but recompute every hit and compare
+const char *cacheModeNames[] = {"off", "on", "verify"};
+int cacheMode = CACHE_ON;
 
-typedef struct {
-	int pid;
-	int resourceId;
-} WaitQueueEntry;
+//Safety kernel (-X): the packed, branch-free kernels from kernels.h or the generic int matrix scan
+#define KERNEL_AUTO 0 //the unrolled variant for our shape if there is one, else the runtime-shape packed kernel
+#define KERNEL_PACKED 1 //always the runtime-shape packed kernel
+#define KERNEL_GENERIC 2
+const char *kernelModeNames[] = {"auto", "packed", "generic"};
+int kernelMode = KERNEL_AUTO;
+SafetyKernelFn safetyKernel = NULL; //NULL = generic
+const char *safetyKernelName = "generic";
+int stat_kernel_verify_mismatches = 0; //-C verify: the kernel and the generic scan disagreed
 
-WaitQueueEntry waitQueue[MAX_WAIT_QUEUE];
-int waitQueueSize = 0;
+//Zobrist hash of (allocation, max claim, live slots), updated on every change through the setters below
+uint64_t zobristAllocation[18][NUM_RESOURCES][NUM_INSTANCES + 1];
+uint64_t zobristMax[18][NUM_RESOURCES][NUM_INSTANCES + 1];
+uint64_t zobristLive[18];
+uint64_t zobristSlot[18];
+uint64_t zobristRequest[NUM_RESOURCES][NUM_INSTANCES + 1];
+uint64_t stateHash = 0;
 
-//Add a request to the wait queue
-void addToWaitQueue(int pid, int resourceId) {
-	if (waitQueueSize < MAX_WAIT_QUEUE) {
-		waitQueue[waitQueueSize].pid = pid;
-		waitQueue[waitQueueSize].resourceId = resourceId;
-		waitQueueSize++;
-	} else {
-		fprintf(stderr, "Wait queue is full!\n");
-	}
+uint64_t splitmix64(uint64_t *seed) {
+	uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
 }
 
-//Remove a request from the wait queue by index
-void removeFromWaitQueue(int index) {
-	if (index < 0 || index >= waitQueueSize) return;
-	for (int i = index; i < waitQueueSize - 1; i++) {
-		waitQueue[i] = waitQueue[i + 1];
+//Hash of the whole state from scratch; the running stateHash must always equal this
+uint64_t computeStateHash() {
+	uint64_t h = 0;
+	for (int i = 0; i < 18; i++) {
+		if (processTable[i].pid != 0) h ^= zobristLive[i];
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			h ^= zobristAllocation[i][j][allocation[i][j]];
+			h ^= zobristMax[i][j][max[i][j]];
+		}
 	}
-	waitQueueSize--;
+	return h;
 }
 
-//Try to grant requests in the wait queue
-void processWaitQueue() {
-	int i = 0;
-	while (i < waitQueueSize) {
-		int pid = waitQueue[i].pid;
-		int resourceId = waitQueue[i].resourceId;
-
-		//SAFETY CHECK
-		if (resourceId < 0 || resourceId >= NUM_RESOURCES) {
-			oss_log("OSS Warning: Invalid resource ID %d in wait queue for process %d. Skipping.\n", resourceId, pid);
-			removeFromWaitQueue(i); //remove invalid
-			continue;
+void initStateHash() {
+	uint64_t seed = 0x4F5353u; //fixed so verdicts are reproducible across runs
+	for (int i = 0; i < 18; i++) {
+		zobristLive[i] = splitmix64(&seed);
+		zobristSlot[i] = splitmix64(&seed);
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			for (int v = 0; v <= NUM_INSTANCES; v++) {
+				zobristAllocation[i][j][v] = splitmix64(&seed);
+				zobristMax[i][j][v] = splitmix64(&seed);
+			}
 		}
-
-		int granted = handleResourceRequest(pid, resourceId);
-		if (granted == 1) {
-			send_message_to_worker(pid, 1);
-			stat_requests_granted_after_wait++;
-			removeFromWaitQueue(i); //remove and don't increment i 
-		} else {
-			i++; //only increment if not removed
+	}
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		for (int v = 0; v <= NUM_INSTANCES; v++) {
+			zobristRequest[j][v] = splitmix64(&seed);
 		}
 	}
+	stateHash = computeStateHash();
 }
 
-//signal handler
-void sigint_handler(int sig) {
-	oss_log("OSS: Caught SIGINT, cleaning up...\n");
+//Sparse view of allocation, kept in step by setAllocation so scans only touch instances actually held.
+//Row i packs the resources process i holds; column r lists the processes holding resource r.
+int heldResources[18][NUM_RESOURCES]; //first heldCount[i] entries are valid
+int heldCount[18];
+int heldTotal[18]; //instances held by each process, over all resources
+int leaseUnclaimed[18][NUM_RESOURCES]; //part of allocation that is an unclaimed lease, as oss last saw it
+int leaseUnclaimedTotal[18];
+int holders[NUM_RESOURCES][18]; //first holderCount[r] entries are valid
+int holderCount[NUM_RESOURCES];
+int heldPos[18][NUM_RESOURCES]; //1 + index of r in heldResources[i], 0 if not held
+int holderPos[18][NUM_RESOURCES]; //1 + index of i in holders[r], 0 if not held
 
-	//kill all remanining user processes
+void sparseInsert(int i, int j) {
+	heldResources[i][heldCount[i]] = j;
+	heldPos[i][j] = ++heldCount[i];
+	holders[j][holderCount[j]] = i;
+	holderPos[i][j] = ++holderCount[j];
+}
+
+//Swap-remove from both lists so removal stays O(1)
+void sparseRemove(int i, int j) {
+	int k = heldPos[i][j] - 1;
+	int lastResource = heldResources[i][--heldCount[i]];
+	heldResources[i][k] = lastResource;
+	heldPos[i][lastResource] = k + 1;
+	heldPos[i][j] = 0;
+
+	k = holderPos[i][j] - 1;
+	int lastHolder = holders[j][--holderCount[j]];
+	holders[j][k] = lastHolder;
+	holderPos[lastHolder][j] = k + 1;
+	holderPos[i][j] = 0;
+}
+
+//Packed copy of need and allocation, one resource per 8-bit lane (see kernels.h), kept in step by the
+//setters so the safety kernels never have to pack a matrix on the decision path
+uint64_t packedNeed[18];
+uint64_t packedAllocation[18];
+uint32_t liveMask; //bit i set while slot i holds a process
+
+void initPackedState() {
+	liveMask = 0;
 	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid != 0) {
-			kill(processTable[i].pid, SIGTERM);
-		}
+		packedNeed[i] = pack_lanes(need[i], NUM_RESOURCES);
+		packedAllocation[i] = pack_lanes(allocation[i], NUM_RESOURCES);
+		if (processTable[i].pid != 0) liveMask |= (uint32_t)1 << i;
 	}
+}
 
-	//Wait for all children to exit
-	while (wait(NULL) > 0);
+uint32_t safetyKernelRuntimeShape(uint64_t work, const uint64_t *need, const uint64_t *give, uint32_t pending) {
+	return safety_kernel_packed(18, NUM_RESOURCES, work, need, give, pending);
+}
 
-	//clean up shared memory
-	cleanup_shared_memory();
+//Pick the safety kernel once at startup; shapes that don't fit the 8-bit lanes stay generic
+void selectSafetyKernel() {
+	safetyKernel = NULL;
+	safetyKernelName = "generic";
+	if (kernelMode == KERNEL_GENERIC) return;
+	if (!PACKED_SHAPE_FITS(NUM_RESOURCES, NUM_INSTANCES)) {
+		oss_log("OSS: %d resources of %d instances don't fit the packed kernels, using the generic check\n",
+			NUM_RESOURCES, NUM_INSTANCES);
+		return;
+	}
+	const SafetyKernel *unrolled = find_safety_kernel(18, NUM_RESOURCES);
+	if (kernelMode == KERNEL_AUTO && unrolled != NULL) {
+		safetyKernel = unrolled->fn;
+		safetyKernelName = unrolled->name;
+	} else {
+		safetyKernel = safetyKernelRuntimeShape;
+		safetyKernelName = "packed";
+	}
+	oss_log_verbose("OSS: Using the %s safety kernel\n", safetyKernelName);
+}
 
-	//Close logfile
-	if (logfile) fclose(logfile);
+void profileAllocationChange(int i, int j, int old, int value);
+void lifeHoldChange(int i, int oldTotal, int newTotal);
 
-	exit(1);
+//available[j] and the resource table's copy of it change together
+void setAvailable(int j, int value) {
+	available[j] = value;
+	resourceTable[j].availableInstances = value;
 }
 
-//Function to check if the system is in a safe state
-bool isSafe(int processId, int resourceId, int request);
+//Set allocation[i][j] and how much of it is an unclaimed lease. The profile and the lifecycle only see
+//the rest: a lease is held from when the worker claims it, not from when oss issues it.
+void setLeasedAllocation(int i, int j, int value, int unclaimed) {
+	int old = allocation[i][j];
+	int oldUnclaimed = leaseUnclaimed[i][j];
+	int held = heldTotal[i] - leaseUnclaimedTotal[i];
+	profileAllocationChange(i, j, old - oldUnclaimed, value - unclaimed);
+	lifeHoldChange(i, held, held + (value - unclaimed) - (old - oldUnclaimed));
+	leaseUnclaimed[i][j] = unclaimed;
+	leaseUnclaimedTotal[i] += unclaimed - oldUnclaimed;
+	if (old == 0 && value > 0) sparseInsert(i, j);
+	else if (old > 0 && value == 0) sparseRemove(i, j);
+	heldTotal[i] += value - old;
+	stateHash ^= zobristAllocation[i][j][old] ^ zobristAllocation[i][j][value];
+	allocation[i][j] = value;
+	need[i][j] = max[i][j] - value;
+	resourceTable[j].allocated[i] = value;
+	packedAllocation[i] = lane_set(packedAllocation[i], j, value);
+	packedNeed[i] = lane_set(packedNeed[i], j, need[i][j]);
+}
 
-// Function to initialize the resource table
-void initializeResourceTable() {
-	for (int i = 0; i < NUM_RESOURCES; i++) {
-		resourceTable[i].totalInstances = NUM_INSTANCES;
-		resourceTable[i].availableInstances = NUM_INSTANCES;
-		for (int j = 0; j < 18; j++) {
-			resourceTable[i].allocated[j] = 0;
-		}
-	}
+//Workers claim leases without telling oss; count what they claimed since oss last looked as held now
+void syncLeaseClaims(int i, int j) {
+	if (leaseUnclaimed[i][j] == 0 || sharedState == NULL) return;
+	uint64_t word = atomic_load(&sharedState->leases.lease[i][j]);
+	int left = LEASE_PID(word) == processTable[i].pid ? LEASE_COUNT(word) : 0;
+	if (left < leaseUnclaimed[i][j]) setLeasedAllocation(i, j, allocation[i][j], left);
 }
 
-//Function to handle resource requests
-int handleResourceRequest(int pid, int resourceId) {
-	int processIndex = -1;
-	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid == pid) {
-			processIndex = i;
-			break;
+//Set allocation[i][j] (need follows from the max claim) and keep the hash, sparse view, resource table and profile in step
+void setAllocation(int i, int j, int value) {
+	syncLeaseClaims(i, j);
+	setLeasedAllocation(i, j, value, leaseUnclaimed[i][j]);
+}
+
+//Give back everything process i holds, including any lease it hasn't claimed
+void reclaimAllocation(int i) {
+	if (sharedState != NULL) {
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			atomic_store(&sharedState->leases.lease[i][j], 0);
 		}
 	}
-
-	if (processIndex == -1) {
-		oss_log("OSS Warning: Received message from dead process %d\n", pid);
-		return -1; //Process not found
+	while (heldCount[i] > 0) {
+		int j = heldResources[i][heldCount[i] - 1];
+		setAvailable(j, available[j] + allocation[i][j]);
+		setLeasedAllocation(i, j, 0, 0);
 	}
+	if (oracleEnabled) oracleReclaim(i);
+}
 
-	//VALIDATION
-	if (resourceId < 0 || resourceId >= NUM_RESOURCES) {
-		oss_log("OSS Warning: Invalid resourceId %d received in handleResourceRequest. Skipping.\n", resourceId);
-		return 0; //Safely skip bad resource ID
-	}
+void setMaxClaim(int i, int j, int value) {
+	stateHash ^= zobristMax[i][j][max[i][j]] ^ zobristMax[i][j][value];
+	max[i][j] = value;
+	need[i][j] = value - allocation[i][j];
+	packedNeed[i] = lane_set(packedNeed[i], j, need[i][j]);
+	if (oracleEnabled) oracleClaim(i, j, value);
+}
 
-	//Check if enough resources available
-	if (available[resourceId] < 1) {
-		return 0; //can't grant
+void setSlotPid(int i, pid_t pid) {
+	if ((processTable[i].pid != 0) != (pid != 0)) stateHash ^= zobristLive[i];
+	if (pid == 0 && processTable[i].pid != 0 && federatedPartitions > 0 && partitionId == 0) {
+		sharedState->federation.claims[i].pid = 0;
+		federationSlotFreed(processTable[i].pid);
 	}
+	processTable[i].pid = pid;
+	if (pid != 0) liveMask |= (uint32_t)1 << i;
+	else liveMask &= ~((uint32_t)1 << i);
+	if (oracleEnabled) oracleSlot(i, pid);
+}
 
-	//Check if the request can be granted safely
-	if (isSafe(pid, resourceId, 1)) { //assuming each request is for 1 instance
-		resourceTable[resourceId].availableInstances--;
-		available[resourceId]--;
-		resourceTable[resourceId].allocated[processIndex]++;
-		allocation[processIndex][resourceId]++; //update allocation
-		need[processIndex][resourceId]--; //update need
-
-		//Update statistics
-		if (waitQueueSize > 0) {
-			stat_requests_granted_after_wait++;
-		} else {
-			stat_requests_granted_immediately++;
+//CPU placement (-A, -P). oss can be pinned to one CPU, and each worker is pinned according to its slot,
+//so the same slot lands on the same CPU in every run. Placement is set in the child before exec.
+#define PLACE_NONE 0 //leave workers to the scheduler
+#define PLACE_COMPACT 1 //slot i on the i-th CPU of the set, wrapping round
+#define PLACE_SPREAD 2 //slots spread evenly over the whole set, neighbouring slots share a CPU
+#define PLACE_EXCLUDE 3 //any CPU of the set except oss's
+const char *placementNames[] = {"none", "compact", "spread", "exclude"};
+int workerPlacement = PLACE_NONE; //-P policy[:cpus]
+char *placementCpuSpec = NULL; //cpu list from -P, e.g. "0-3,6"
+int ossCpu = -1; //-A: CPU oss is pinned to, -1 = not pinned
+int placementCpus[CPU_SETSIZE]; //CPUs workers may use, ascending
+int placementCpuCount = 0;
+cpu_set_t inheritedAffinity; //oss's affinity before -A pinned it
+
+//Parse a CPU list such as "0-3,6" into set. False on malformed input.
+bool parseCpuList(const char *spec, cpu_set_t *set) {
+	CPU_ZERO(set);
+	char copy[256];
+	snprintf(copy, sizeof(copy), "%s", spec);
+	for (char *part = strtok(copy, ","); part != NULL; part = strtok(NULL, ",")) {
+		char *end;
+		long first = strtol(part, &end, 10);
+		long last = first;
+		if (end == part) return false;
+		if (*end == '-') {
+			char *rangeEnd = end + 1;
+			last = strtol(rangeEnd, &end, 10);
+			if (end == rangeEnd) return false;
 		}
+		if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) return false;
+		for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+	}
+	return true;
+}
 
-		oss_log_verbose("OSS: Process %d requesting resource %d\n", pid, resourceId);
-		return 1; //Granted
-	} else {
-		return 0; //Denied (unsafe state)
+void formatCpuList(char *buf, size_t size) {
+	size_t used = 0;
+	buf[0] = '\0';
+	for (int k = 0; k < placementCpuCount && used < size; k++) {
+		used += snprintf(buf + used, size - used, k ? ",%d" : "%d", placementCpus[k]);
 	}
 }
 
-// Function to handle resource releases
-void handleResourceRelease(int pid, int resourceId) {
-	int processIndex = -1;
-	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid == pid) {
-			processIndex = i;
-			break;
+//Work out the worker CPU set and pin oss. Exits on a placement that can't be honoured.
+void setupPlacement() {
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		perror("sched_getaffinity");
+		exit(1);
+	}
+	inheritedAffinity = allowed;
+	if (placementCpuSpec) {
+		cpu_set_t requested;
+		if (!parseCpuList(placementCpuSpec, &requested)) {
+			fprintf(stderr, "Bad CPU list '%s'\n", placementCpuSpec);
+			exit(1);
 		}
+		CPU_AND(&allowed, &allowed, &requested);
 	}
-
-	if (processIndex == -1) {
-		oss_log("OSS Warning:: Process with PID %d not found in process table\n", pid);
-		return; //process not found
+	if (workerPlacement == PLACE_EXCLUDE && ossCpu == -1) {
+		//Excluding oss's CPU only means something once oss has one; take the first of the set
+		for (int cpu = 0; cpu < CPU_SETSIZE && ossCpu == -1; cpu++) {
+			if (CPU_ISSET(cpu, &allowed)) ossCpu = cpu;
+		}
+	}
+	if (ossCpu != -1) {
+		cpu_set_t one;
+		CPU_ZERO(&one);
+		CPU_SET(ossCpu, &one);
+		if (sched_setaffinity(0, sizeof(one), &one) == -1) {
+			fprintf(stderr, "Can't pin oss to CPU %d: %s\n", ossCpu, strerror(errno));
+			exit(1);
+		}
+		if (workerPlacement == PLACE_EXCLUDE) CPU_CLR(ossCpu, &allowed);
+	}
+	placementCpuCount = 0;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed)) placementCpus[placementCpuCount++] = cpu;
+	}
+	if (workerPlacement != PLACE_NONE && placementCpuCount == 0) {
+		fprintf(stderr, "No CPUs left for workers under '%s' placement\n", placementNames[workerPlacement]);
+		exit(1);
 	}
+}
 
-	if (resourceTable[resourceId].allocated[processIndex] > 0) {
-		resourceTable[resourceId].availableInstances++;
-		available[resourceId]++;
-		resourceTable[resourceId].allocated[processIndex]--;
-		oss_log_verbose("OSS: Process %d releasing resource %d\n", pid, resourceId);
+//Pin forked partition p (-F) to its own CPU: the p-th one after the primary's in the set oss started
+//with, wrapping round. Without -A the partitions stay unpinned, like the primary.
+void placePartition(int p) {
+	if (ossCpu == -1) return;
+	int cpus[CPU_SETSIZE];
+	int count = 0, primary = 0;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &inheritedAffinity)) continue;
+		if (cpu == ossCpu) primary = count;
+		cpus[count++] = cpu;
+	}
+	cpu_set_t one;
+	CPU_ZERO(&one);
+	CPU_SET(cpus[(primary + p) % count], &one);
+	if (sched_setaffinity(0, sizeof(one), &one) == -1) {
+		fprintf(stderr, "Can't pin partition %d to CPU %d: %s\n", p, cpus[(primary + p) % count], strerror(errno));
+		ossCpu = -1;
+		return;
 	}
+	ossCpu = cpus[(primary + p) % count];
 }
 
-// Function to send a message to a worker process
-int send_message_to_worker(pid_t worker_pid, int status) {
-	struct worker_message worker_response;
-	worker_response.mtype = worker_pid; //Child's PID
-    	worker_response.status = status; //1 = success, 0 = deny
-	if (msgsnd(msqid, &worker_response, sizeof(worker_response) - sizeof(long), 0) == -1) {
-		perror("msgsnd (response to worker)");
-		return -1;
+//Pin the calling process (a worker between fork and exec) for the given slot
+void placeWorker(int slot) {
+	if (workerPlacement == PLACE_NONE) {
+		//Without a policy workers run wherever oss could before -A pinned it, not on oss's one CPU
+		if (ossCpu != -1 && sched_setaffinity(0, sizeof(inheritedAffinity), &inheritedAffinity) == -1) {
+			perror("sched_setaffinity");
+		}
+		return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (workerPlacement == PLACE_COMPACT) {
+		CPU_SET(placementCpus[slot % placementCpuCount], &set);
+	} else if (workerPlacement == PLACE_SPREAD) {
+		CPU_SET(placementCpus[slot * placementCpuCount / MAX_PROCESSES], &set);
+	} else {
+		for (int k = 0; k < placementCpuCount; k++) CPU_SET(placementCpus[k], &set);
+	}
+	if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+		perror("sched_setaffinity");
 	}
-	return 0;
 }
 
+// Add new global variables
+int maxProcesses = 18;  // Maximum number of processes
+int maxRuntimeSeconds = 5;  // Maximum runtime in simulated seconds (-s, or 'extend'/'runtime' on the control channel)
+int launchIntervalMs = DEFAULT_LAUNCH_INTERVAL_MS;  // Launch interval in milliseconds
 
-//Function to setup shared memory for the clock
-int setup_shared_memory() {
-	key_t key = ftok("oss.c", 1); //Using "oss.c" as the file for ftok
-	if (key == -1) {
-		perror("ftok");
-		return 1;
-	}
+//Admission control thresholds
+#define HEADROOM_UNLIMITED (-1000000)
+#define DEFAULT_ADMISSION_MAX_WAIT 10
+#define DEFAULT_ADMISSION_REJECT_MS 1000
+int admissionMinHeadroom = HEADROOM_UNLIMITED; //-H: delay launches while headroom is below this
+int admissionMaxWait = DEFAULT_ADMISSION_MAX_WAIT; //-Q: delay launches while this many requests are blocked
+int admissionRejectMs = DEFAULT_ADMISSION_REJECT_MS; //drop a launch delayed longer than this (sim ms)
 
-	shmid = shmget(key, sizeof(SimulatedClock), IPC_CREAT | 0666);
-	if (shmid == -1) {
-		perror("shmget");
-		return 1;
-	}
 
-	simClock = (SimulatedClock *)shmat(shmid, NULL, 0);
-	if (simClock == (SimulatedClock *) -1) {
-		perror("shmat");
-		return 1;
-	}
+//Wait queue for blocked resource requests
+#define MAX_WAIT_QUEUE 100
 
-	//Initialize the clock
-	simClock->seconds = 0;
-	simClock->nanoseconds = 0;
+//Wait queue scheduling policies (-p)
+#define POLICY_FIFO 0 //oldest request first
+#define POLICY_SNF 1 //shortest remaining need first
+#define POLICY_MHF 2 //most resources held first (frees capacity sooner)
+#define POLICY_AGING 3 //shortest need first, but every AGING_QUANTUM_NS waited is worth one unit of need
+#define AGING_QUANTUM_NS 100000000LL
+const char *policyNames[] = {"fifo", "snf", "mhf", "aging"};
+int waitPolicy = POLICY_FIFO;
 
-	return 0;
-}
+typedef struct {
+	int pid;
+	int resourceId; //resource of a single-instance request, -1 for a vector request
+	int counts[NUM_RESOURCES]; //instances wanted of each resource
+	long long key; //priority under waitPolicy, smaller is served first
+	unsigned long seq; //insertion order, breaks ties so equal keys stay FIFO
+	long long enqueueNs; //sim time the request started waiting
+} WaitQueueEntry;
 
-//Function to clean up shared memory
-void cleanup_shared_memory() {
-	//Send SIGTERM to all active children
-	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid != 0) {
-            		kill(processTable[i].pid, SIGTERM);
-        	}
-	}
-	
-	//Wait for all children to exit
-	while (wait(NULL) > 0); //This ensures wait for all children
+//Binary min-heap ordered by (key, seq)
+WaitQueueEntry waitQueue[MAX_WAIT_QUEUE];
+int waitQueueSize = 0;
+unsigned long waitQueueSeq = 0;
+bool waitQueueDirty = false; //capacity came back since the last pass, so a pass may grant something
+long long stat_wait_total_ns = 0; //sim time spent blocked by requests granted from the queue
 
-	//if (simClock != (SimulatedClock *)-1) {
-	//	shmdt(simClock);
-	//}
-	//if (shmid != -1) {
-	//	shmctl(shmid, IPC_RMID, NULL); //Mark for destruction
-	//}
+long long simTimeNs() {
+	return (long long)simClock->seconds * 1000000000 + simClock->nanoseconds;
+}
 
-	//Clean up IPC resources
-	shmdt(simClock);
-    	shmctl(shmid, IPC_RMID, NULL);
-    	msgctl(msqid, IPC_RMID, NULL);
-    
-    	if (logfile) fclose(logfile);
+//All clock writes go through here so workers pacing on simulated time see one consistent value
+void setSimClock(long long ns) {
+	simClock->seconds = ns / 1000000000;
+	simClock->nanoseconds = ns % 1000000000;
+	atomic_store(&sharedState->pacing.nowNs, ns);
 }
 
-//Function to check if the system is in a safe state
-bool isSafe(int processId, int resourceId, int request) {
-	if (available[resourceId] < request) {
-		return false; //Not enough available
-	}
+void advanceSimClock(long long ns) {
+	setSimClock(simTimeNs() + ns);
+}
 
-	int work[NUM_RESOURCES]; //available resources
-	bool finish[18]; //indicates if a process can finish
-	int temp_allocation[18][NUM_RESOURCES]; //temporary allocation matrix
+//Hierarchical timer wheel on simulated time. Level 0 has one slot per 1 ms tick; a slot on
+//level L spans a full turn of level L-1 and is cascaded down when that turn completes.
+#define WHEEL_TICK_NS 1000000LL
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4 //64^4 ms, about 4.6 simulated hours
 
-	//1. Initialize work and finish
-	for (int i = 0; i < NUM_RESOURCES; i++) {
-		work[i] = available[i];
-	}
-	for (int i = 0; i < 18; i++) {
-		finish[i] = false;
-	}
+typedef struct SimTimer {
+	const char *name;
+	void (*fire)(struct SimTimer *timer);
+	long long expiresTick;
+	long long periodTicks; //re-armed this far after each expiry, 0 = one-shot
+	bool armed;
+	struct SimTimer *next;
+	struct SimTimer *prev;
+} SimTimer;
 
-	//2. Simulate the allocation
-	work[resourceId] -= request;
+SimTimer *timerWheel[WHEEL_LEVELS][WHEEL_SLOTS];
+long long wheelTick = 0; //last tick whose timers have fired
+int stat_timer_fires = 0;
 
-	//2.5 Copy allocation to temp_allocation
-	for (int i = 0; i < 18; i++) {
-		for (int j = 0; j < NUM_RESOURCES; j++) {
-			temp_allocation[i][j] = allocation[i][j];
-		}
+void wheelInsert(SimTimer *timer) {
+	long long delta = timer->expiresTick - wheelTick;
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= (1LL << (WHEEL_BITS * (level + 1)))) {
+		level++;
 	}
+	int slot = (timer->expiresTick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+	timer->prev = NULL;
+	timer->next = timerWheel[level][slot];
+	if (timer->next) timer->next->prev = timer;
+	timerWheel[level][slot] = timer;
+}
 
-	int processIndex = -1;
-	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid == processId) {
-			processIndex = i;
-			break;
+void wheelUnlink(SimTimer *timer, SimTimer **head) {
+	if (timer->prev) timer->prev->next = timer->next;
+	else *head = timer->next;
+	if (timer->next) timer->next->prev = timer->prev;
+	timer->next = timer->prev = NULL;
+}
+
+void cancelTimer(SimTimer *timer) {
+	if (!timer->armed) return;
+	for (int level = 0; level < WHEEL_LEVELS; level++) {
+		SimTimer **head = &timerWheel[level][(timer->expiresTick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+		for (SimTimer *t = *head; t; t = t->next) {
+			if (t == timer) {
+				wheelUnlink(timer, head);
+				timer->armed = false;
+				return;
+			}
 		}
 	}
-	
-	//Simulate allocating the resource
-	temp_allocation[processIndex][resourceId] += request; //newly added
+}
 
-	//3. Find a process that can finish
-	int count = 0;
-	while (count < 18) {
-		bool found = false;
-		for (int i = 0; i < 18; i++) {
-			if (!finish[i]) {
-				bool canFinish = true;
-				for (int j = 0; j < NUM_RESOURCES; j++) {
-					if (need[i][j] > work[j]) {
-						canFinish = false;
-						break;
-					}
-				}
-				if (canFinish) {
-					for (int j = 0; j < NUM_RESOURCES; j++) {
-						work[j] += temp_allocation[i][j];
-					}
-					finish[i] = true;
-					count++;
-					found = true;
-				}
+//Arm (or re-arm) a timer to fire delayTicks after the current tick, at least one tick out
+void scheduleTimer(SimTimer *timer, long long delayTicks) {
+	cancelTimer(timer);
+	if (delayTicks < 1) delayTicks = 1;
+	timer->expiresTick = wheelTick + delayTicks;
+	timer->armed = true;
+	wheelInsert(timer);
+}
+
+void schedulePeriodicTimer(SimTimer *timer, long long periodTicks) {
+	timer->periodTicks = periodTicks;
+	scheduleTimer(timer, periodTicks);
+}
+
+//Fire everything due up to the current simulated time; cost is per tick, not per registered timer
+void advanceTimerWheel() {
+	long long nowTick = simTimeNs() / WHEEL_TICK_NS;
+	while (wheelTick < nowTick) {
+		wheelTick++;
+		//At the end of a level's turn, move the next slot of the level above down
+		for (int level = 1; level < WHEEL_LEVELS && (wheelTick & ((1LL << (WHEEL_BITS * level)) - 1)) == 0; level++) {
+			int slot = (wheelTick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+			SimTimer *t = timerWheel[level][slot];
+			timerWheel[level][slot] = NULL;
+			while (t) {
+				SimTimer *next = t->next;
+				wheelInsert(t);
+				t = next;
 			}
 		}
-		if (!found) {
-			return false; //Unsafe state
+		//Pop one at a time; a callback may arm or cancel other timers
+		SimTimer **head = &timerWheel[0][wheelTick & (WHEEL_SLOTS - 1)];
+		while (*head) {
+			SimTimer *t = *head;
+			wheelUnlink(t, head);
+			t->armed = false;
+			if (t->periodTicks > 0) {
+				scheduleTimer(t, t->periodTicks);
+			}
+			stat_timer_fires++;
+			t->fire(t);
 		}
 	}
-	return true; //Safe state
 }
 
-//Deadlock detection and recovery
-void detectAndResolveDeadlock() {
-	stat_deadlock_detection_runs++;
-	bool finish[18];
-	int work[NUM_RESOURCES];
-	int temp_allocation[18][NUM_RESOURCES];
-	int temp_need[18][NUM_RESOURCES];
-	int deadlocked[18];
-	int deadlockedCount = 0;
+//Per-resource contention profile
+#define HOLD_BUCKETS 16 //bucket b counts holds shorter than 2^b ms; the last one is open-ended
+#define PROFILE_TOP_N 3
+#define WAIT_UNAVAILABLE 0 //not enough free instances
+#define WAIT_UNSAFE 1 //instances free, but granting them would leave an unsafe state
 
-	//Initialize work and finish
-	for (int i = 0; i < NUM_RESOURCES; i++) {
-		work[i] = available[i];
+typedef struct {
+	int requests; //requests that asked for this resource
+	int grants;
+	int waitsUnavailable;
+	int waitsUnsafe;
+	int deniedClaim; //asked for more than the process claimed
+	int allocated; //instances currently held
+	long long busyNs; //integral of allocated instances over sim time
+	long long lastAllocChangeNs;
+	int queued; //wait queue entries asking for this resource
+	long long queueNs; //integral of queued over sim time
+	long long lastQueueChangeNs;
+	int holds; //instances released so far, with their grant->release times
+	long long holdTotalNs;
+	long long holdMaxNs;
+	int holdBuckets[HOLD_BUCKETS];
+} ResourceProfile;
+
+ResourceProfile resourceProfile[NUM_RESOURCES];
+long long heldSince[18][NUM_RESOURCES][NUM_INSTANCES]; //grant times of held instances, oldest at heldSinceHead
+int heldSinceHead[18][NUM_RESOURCES];
+
+void recordHold(ResourceProfile *prof, long long holdNs) {
+	prof->holds++;
+	prof->holdTotalNs += holdNs;
+	if (holdNs > prof->holdMaxNs) prof->holdMaxNs = holdNs;
+	int b = 0;
+	while (b < HOLD_BUCKETS - 1 && holdNs >= (1LL << b) * 1000000) b++;
+	prof->holdBuckets[b]++;
+}
+
+//Called by setAllocation. Instances are interchangeable, so the oldest one held is taken to be released first.
+void profileAllocationChange(int i, int j, int old, int value) {
+	ResourceProfile *prof = &resourceProfile[j];
+	long long now = simClock ? simTimeNs() : 0;
+	prof->busyNs += (long long)prof->allocated * (now - prof->lastAllocChangeNs);
+	prof->lastAllocChangeNs = now;
+	prof->allocated += value - old;
+
+	for (int n = old; n < value && n < NUM_INSTANCES; n++) {
+		heldSince[i][j][(heldSinceHead[i][j] + n) % NUM_INSTANCES] = now;
 	}
-	for (int i = 0; i < 18; i++) {
-		finish[i] = (processTable[i].pid == 0); //true if no process
-		deadlocked[i] = 0;
-		for (int j = 0; j < NUM_RESOURCES; j++) {
-			temp_allocation[i][j] = allocation[i][j];
-			temp_need[i][j] = need[i][j];
-		}
+	for (int n = value; n < old; n++) {
+		recordHold(prof, now - heldSince[i][j][heldSinceHead[i][j]]);
+		heldSinceHead[i][j] = (heldSinceHead[i][j] + 1) % NUM_INSTANCES;
 	}
+}
 
-	//Try to find a sequence where all can finish
-	bool progress = true;
-	while (progress) {
-		progress = false;
-		for (int i = 0; i < 18; i++) {
-			if (!finish[i]) {
-				bool canFinish = true;
-				for (int j = 0; j < NUM_RESOURCES; j++) {
-					if (temp_need[i][j] > work[j]) {
-						canFinish = false;
-						break;
-					}
-				}
-				if (canFinish) {
-					for (int j = 0; j < NUM_RESOURCES; j++) {
-						work[j] += temp_allocation[i][j];
-					}
-					finish[i] = true;
-					progress = true;
-				}
-			}
-		}
+//Wait queue entries came (+1) or went (-1) for every resource in counts
+void profileQueueChange(const int *counts, int delta) {
+	long long now = simTimeNs();
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (counts[j] <= 0) continue;
+		ResourceProfile *prof = &resourceProfile[j];
+		prof->queueNs += (long long)prof->queued * (now - prof->lastQueueChangeNs);
+		prof->lastQueueChangeNs = now;
+		prof->queued += delta;
 	}
+}
 
-	//Any process not finished is deadlocked
-	for (int i = 0; i < 18; i++) {
-		if (!finish[i] && processTable[i].pid != 0) {
-			deadlocked[deadlockedCount++] = i;
-		}
+void profileRequest(const int *counts) {
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (counts[j] > 0) resourceProfile[j].requests++;
 	}
+}
 
-	if (deadlockedCount == 0) {
-		oss_log("OSS: Deadlock detection: No deadlocks detected at time %u:%u\n", simClock->seconds, simClock->nanoseconds);
-		return;
+//Approximate hold-time percentile (ms): upper edge of the bucket that contains it
+double holdPercentileMs(const ResourceProfile *prof, double pct) {
+	if (prof->holds == 0) return 0.0;
+	int target = (int)(pct * prof->holds + 0.999999);
+	int seen = 0;
+	for (int b = 0; b < HOLD_BUCKETS - 1; b++) {
+		seen += prof->holdBuckets[b];
+		if (seen >= target) return (1LL << b) < prof->holdMaxNs / 1e6 ? (double)(1LL << b) : prof->holdMaxNs / 1e6;
 	}
+	return prof->holdMaxNs / 1e6;
+}
 
-	oss_log("OSS: Deadlock detected at time %u%u. Deadlocked processes:", simClock->seconds, simClock->nanoseconds);
-	for (int i = 0; i < deadlockedCount; i++) {
-		oss_log(" P%d", deadlocked[i]);
+double profileUtilization(const ResourceProfile *prof, long long now) {
+	long long busy = prof->busyNs + (long long)prof->allocated * (now - prof->lastAllocChangeNs);
+	return now > 0 ? (double)busy / ((double)NUM_INSTANCES * now) : 0.0;
+}
+
+double profileMeanQueueDepth(const ResourceProfile *prof, long long now) {
+	long long queued = prof->queueNs + (long long)prof->queued * (now - prof->lastQueueChangeNs);
+	return now > 0 ? (double)queued / now : 0.0;
+}
+
+SimTimer grantReportTimer; //one-shot, armed every 20 grants
+
+//Count a grant; every 20th one schedules a table dump for the next tick
+void countGrant(bool afterWait) {
+	if (afterWait) {
+		stat_requests_granted_after_wait++;
+	} else {
+		stat_requests_granted_immediately++;
 	}
-	oss_log("\n");
+	if ((stat_requests_granted_immediately + stat_requests_granted_after_wait) % 20 == 0) {
+		scheduleTimer(&grantReportTimer, 1);
+	}
+}
 
-	//Termiante deadlocked processes one by one until deadlock is resolved
-	for (int k = 0; k < deadlockedCount; k++) {
-		int idx = deadlocked[k];
-		pid_t pid = processTable[idx].pid;
-		oss_log("OSS: Terminating process P%d (PID %d) to resolve deadlock\n", idx, pid);
-		//Release all resources held by this process
+int findProcessIndex(int pid) {
+	for (int i = 0; i < 18; i++) {
+		if (processTable[i].pid == pid) return i;
+	}
+	return -1;
+}
+
+//A blocked process can't request or release, so its need and holdings (and key) stay fixed while it waits
+long long waitQueueKey(int processIndex, long long enqueueNs) {
+	int remaining = 0, held = heldTotal[processIndex];
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		remaining += need[processIndex][j];
+	}
+	switch (waitPolicy) {
+		case POLICY_SNF: return remaining;
+		case POLICY_MHF: return -held;
+		case POLICY_AGING: return enqueueNs / AGING_QUANTUM_NS + remaining;
+		default: return 0;
+	}
+}
+
+bool waitQueueLess(int a, int b) {
+	if (waitQueue[a].key != waitQueue[b].key) return waitQueue[a].key < waitQueue[b].key;
+	return waitQueue[a].seq < waitQueue[b].seq;
+}
+
+void waitQueueSwap(int a, int b) {
+	WaitQueueEntry tmp = waitQueue[a];
+	waitQueue[a] = waitQueue[b];
+	waitQueue[b] = tmp;
+}
+
+void waitQueueSiftUp(int i) {
+	while (i > 0 && waitQueueLess(i, (i - 1) / 2)) {
+		waitQueueSwap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+void waitQueueSiftDown(int i) {
+	while (1) {
+		int smallest = i;
+		int left = 2 * i + 1, right = 2 * i + 2;
+		if (left < waitQueueSize && waitQueueLess(left, smallest)) smallest = left;
+		if (right < waitQueueSize && waitQueueLess(right, smallest)) smallest = right;
+		if (smallest == i) return;
+		waitQueueSwap(i, smallest);
+		i = smallest;
+	}
+}
+
+//Push an entry that already has its key
+void waitQueuePush(WaitQueueEntry entry) {
+	profileQueueChange(entry.counts, 1);
+	waitQueue[waitQueueSize] = entry;
+	waitQueueSiftUp(waitQueueSize);
+	waitQueueSize++;
+}
+
+//Add a request vector to the wait queue. Returns false if it is full.
+bool addVectorToWaitQueue(int pid, const int *counts, int resourceId) {
+	revokeAllLeases(); //contention: unclaimed leases go back so the wait queue can use them
+	int processIndex = findProcessIndex(pid);
+	if (waitQueueSize >= MAX_WAIT_QUEUE || processIndex == -1) {
+		fprintf(stderr, "Wait queue is full!\n");
+		return false;
+	}
+	WaitQueueEntry entry;
+	entry.pid = pid;
+	entry.resourceId = resourceId;
+	memcpy(entry.counts, counts, sizeof(entry.counts));
+	entry.enqueueNs = simTimeNs();
+	entry.seq = waitQueueSeq++;
+	entry.key = waitQueueKey(processIndex, entry.enqueueNs);
+	waitQueuePush(entry);
+	lifeWaited(processIndex);
+	return true;
+}
+
+//Remove a request from the wait queue by heap index
+void removeFromWaitQueue(int index) {
+	if (index < 0 || index >= waitQueueSize) return;
+	profileQueueChange(waitQueue[index].counts, -1);
+	waitQueueSize--;
+	if (index == waitQueueSize) return;
+	waitQueue[index] = waitQueue[waitQueueSize];
+	waitQueueSiftUp(index);
+	waitQueueSiftDown(index);
+}
+
+//Recompute every key after waitPolicy changed and restore the heap order
+void rekeyWaitQueue() {
+	for (int w = 0; w < waitQueueSize; w++) {
+		int processIndex = findProcessIndex(waitQueue[w].pid);
+		if (processIndex != -1) waitQueue[w].key = waitQueueKey(processIndex, waitQueue[w].enqueueNs);
+	}
+	for (int w = waitQueueSize / 2 - 1; w >= 0; w--) {
+		waitQueueSiftDown(w);
+	}
+}
+
+//Drop every queued request of a process (it was killed or exited)
+void removeProcessFromWaitQueue(int pid) {
+	for (int w = 0; w < waitQueueSize; ) {
+		if (waitQueue[w].pid == pid) {
+			removeFromWaitQueue(w);
+		} else {
+			w++;
+		}
+	}
+}
+
+//Try to grant requests in the wait queue, in policy order
+void processWaitQueue() {
+	WaitQueueEntry retry[MAX_WAIT_QUEUE];
+	int retryCount = 0;
+	waitQueueDirty = false;
+
+	while (waitQueueSize > 0) {
+		WaitQueueEntry entry = waitQueue[0];
+		removeFromWaitQueue(0);
+
+		//SAFETY CHECK
+		if (entry.resourceId < -1 || entry.resourceId >= NUM_RESOURCES) {
+			oss_log("OSS Warning: Invalid resource ID %d in wait queue for process %d. Skipping.\n", entry.resourceId, entry.pid);
+			continue; //drop invalid
+		}
+
+		//Nothing to hand out: cheaper than the safety check
+		bool fits = true;
 		for (int j = 0; j < NUM_RESOURCES; j++) {
-			available[j] += allocation[idx][j];
-			allocation[idx][j] = 0;
-			need[idx][j] = max[idx][j];
+			if (entry.counts[j] > available[j]) fits = false;
+		}
+		if (!fits) {
+			retry[retryCount++] = entry;
+			continue;
 		}
 
-		//Remove from process table
-		processTable[idx].pid = 0;
-		//Remove from wait queue if present
-		for (int w = 0; w < waitQueueSize; ) {
-			if (waitQueue[w].pid == pid) {
-				removeFromWaitQueue(w);
-			} else {
-				w++;
-			}
+		int granted = handleVectorRequest(entry.pid, entry.counts);
+		if (granted == 1) {
+			send_message_to_worker(entry.pid, 1); //unblocks the worker
+			countGrant(true);
+			stat_wait_total_ns += simTimeNs() - entry.enqueueNs;
+			lifeUnblocked(findProcessIndex(entry.pid), entry.enqueueNs);
+		} else if (granted == 0) {
+			retry[retryCount++] = entry;
+		} //-1: the process is gone, drop the entry
+	}
+
+	//Still blocked; keys are unchanged so they go back in the same order
+	for (int i = 0; i < retryCount; i++) {
+		waitQueuePush(retry[i]);
+	}
+}
+
+//Child exit causes; a child's cause is noted when oss lets it go and settled when it is reaped
+#define EXIT_NORMAL 0 //sent TERMINATE / RELEASE_ALL_TERMINATE
+#define EXIT_DEADLOCK_KILL 1 //killed by deadlock recovery
+#define EXIT_CRASHED 2 //died on a signal or a non-zero status without saying goodbye
+#define EXIT_UNANNOUNCED 3 //exited cleanly without sending TERMINATE
+#define EXIT_SHUTDOWN 4 //still running when the simulation ended
+#define EXIT_CAUSES 5
+const char *exitCauseNames[] = {"normal", "deadlock-kill", "crashed", "unannounced", "shutdown"};
+#define MAX_DEPARTING 64
+
+typedef struct {
+	pid_t pid;
+	int cause;
+} Departure;
+
+Departure departing[MAX_DEPARTING]; //children that left the process table but haven't been reaped yet
+int departingCount = 0;
+
+//Signals are blocked and read from a signalfd in the main loop, so nothing runs in signal context
+int sigfd = -1;
+sigset_t originalSigmask; //restored in forked children before exec
+
+//Per-worker lifecycle in simulated time. The live part sits next to the PCB for each slot; when the
+//slot is freed it is folded into one small record, so a long run costs ~24 bytes per worker lifetime.
+//PCB times: start = launch, service = time holding at least one instance, blocked = time in the
+//wait queue, wait = time from launch to the first grant.
+typedef struct {
+	long long holdSinceNs; //when heldTotal last became non-zero
+	long long instanceNs; //integral of instances held over sim time
+	long long lastHoldChangeNs;
+	long long serviceNs;
+	long long blockedNs;
+	int granted;
+	int denied;
+	int waits;
+	bool everGranted;
+} LiveWorker;
+
+typedef struct {
+	uint32_t turnaroundMs;
+	uint32_t blockedMs;
+	uint32_t serviceMs;
+	uint32_t instanceMs; //instance-milliseconds held, the work thrown away by a deadlock kill
+	uint16_t granted;
+	uint16_t denied;
+	uint16_t waits;
+	uint8_t cause;
+} LifeRecord;
+
+LiveWorker liveWorker[18];
+LifeRecord *lifeRecords = NULL;
+int lifeCount = 0;
+int lifeCapacity = 0;
+int stat_life_records_dropped = 0; //lifetimes not recorded because the record array couldn't grow
+
+void storePcbTime(int *seconds, int *nano, long long ns) {
+	*seconds = ns / 1000000000;
+	*nano = ns % 1000000000;
+}
+
+long long pcbStartNs(int i) {
+	return (long long)processTable[i].startSeconds * 1000000000 + processTable[i].startNano;
+}
+
+//Reset the live accounting of slot i; the PCB times are left as they are (a restore keeps them)
+void resumeLifecycle(int i) {
+	long long now = simTimeNs();
+	memset(&liveWorker[i], 0, sizeof(LiveWorker));
+	liveWorker[i].lastHoldChangeNs = now;
+	liveWorker[i].holdSinceNs = now;
+	liveWorker[i].everGranted = heldTotal[i] > 0;
+	liveWorker[i].serviceNs = (long long)processTable[i].serviceTimeSeconds * 1000000000 + processTable[i].serviceTimeNano;
+	liveWorker[i].blockedNs = (long long)processTable[i].blockedTimeSeconds * 1000000000 + processTable[i].blockedTimeNano;
+}
+
+void startLifecycle(int i) {
+	pid_t pid = processTable[i].pid;
+	memset(&processTable[i], 0, sizeof(PCB));
+	processTable[i].pid = pid;
+	processTable[i].occupied = 1;
+	storePcbTime(&processTable[i].startSeconds, &processTable[i].startNano, simTimeNs());
+	resumeLifecycle(i);
+}
+
+//Called by setAllocation with the process's total instances before and after
+void lifeHoldChange(int i, int oldTotal, int newTotal) {
+	if (oldTotal == newTotal || processTable[i].pid == 0) return;
+	LiveWorker *live = &liveWorker[i];
+	long long now = simClock ? simTimeNs() : 0;
+	live->instanceNs += (long long)oldTotal * (now - live->lastHoldChangeNs);
+	live->lastHoldChangeNs = now;
+	if (oldTotal == 0) {
+		live->holdSinceNs = now;
+	} else if (newTotal == 0) {
+		live->serviceNs += now - live->holdSinceNs;
+		storePcbTime(&processTable[i].serviceTimeSeconds, &processTable[i].serviceTimeNano, live->serviceNs);
+	}
+}
+
+void lifeGranted(int i) {
+	if (i < 0) return;
+	liveWorker[i].granted++;
+	if (!liveWorker[i].everGranted) {
+		liveWorker[i].everGranted = true;
+		storePcbTime(&processTable[i].waitTimeSeconds, &processTable[i].waitTimeNano, simTimeNs() - pcbStartNs(i));
+	}
+}
+
+void lifeDenied(int i) {
+	if (i >= 0) liveWorker[i].denied++;
+}
+
+void lifeWaited(int i) {
+	if (i >= 0) liveWorker[i].waits++;
+}
+
+void lifeUnblocked(int i, long long enqueueNs) {
+	if (i < 0) return;
+	liveWorker[i].blockedNs += simTimeNs() - enqueueNs;
+	storePcbTime(&processTable[i].blockedTimeSeconds, &processTable[i].blockedTimeNano, liveWorker[i].blockedNs);
+}
+
+uint32_t clampMs(long long ns) {
+	long long ms = ns / 1000000;
+	return ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+}
+
+uint16_t clampCount(int n) {
+	return n > UINT16_MAX ? UINT16_MAX : (uint16_t)n;
+}
+
+//Close slot i's lifetime before the slot is freed. A request still queued counts as blocked until now.
+void endLifecycle(int i, int cause) {
+	LiveWorker *live = &liveWorker[i];
+	long long now = simTimeNs();
+	for (int w = 0; w < waitQueueSize; w++) {
+		if (waitQueue[w].pid == processTable[i].pid) lifeUnblocked(i, waitQueue[w].enqueueNs);
+	}
+	int held = heldTotal[i] - leaseUnclaimedTotal[i];
+	live->instanceNs += (long long)held * (now - live->lastHoldChangeNs);
+	if (held > 0) live->serviceNs += now - live->holdSinceNs;
+
+	if (lifeCount == lifeCapacity) {
+		int capacity = lifeCapacity ? lifeCapacity * 2 : 256;
+		LifeRecord *grown = realloc(lifeRecords, capacity * sizeof(LifeRecord));
+		if (grown == NULL) {
+			stat_life_records_dropped++;
+			return;
 		}
-		//send SIGTERM to the process
-		kill(pid, SIGTERM);
-		stat_deadlock_terminations++;
-		stat_deadlock_processes_terminated++;
-		//After terminating one, re-run detection to see if deadlock is resolved
-		oss_log("OSS: Re-running deadlock detection after terminating P%d\n", idx);
-		detectAndResolveDeadlock();
-		break; // only termiante one at a time, then re-check
+		lifeRecords = grown;
+		lifeCapacity = capacity;
 	}
+	LifeRecord *rec = &lifeRecords[lifeCount++];
+	rec->turnaroundMs = clampMs(now - pcbStartNs(i));
+	rec->blockedMs = clampMs(live->blockedNs);
+	rec->serviceMs = clampMs(live->serviceNs);
+	rec->instanceMs = clampMs(live->instanceNs);
+	rec->granted = clampCount(live->granted);
+	rec->denied = clampCount(live->denied);
+	rec->waits = clampCount(live->waits);
+	rec->cause = cause;
 }
 
-//Logging helper function
-void oss_log(const char *fmt, ...) {
-	if (logfile && log_line_count < LOG_LINE_LIMIT) {
-        va_list args;
-        va_start(args, fmt);
-        vfprintf(logfile, fmt, args);
-        va_end(args);
-        fflush(logfile);
-        log_line_count++;
-    }
-    
-    // Always print to stdout
-    va_list args;
-    va_start(args, fmt);
-    vprintf(fmt, args);
-    va_end(args);
-    fflush(stdout);
+int compareDouble(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
 }
 
-void oss_log_verbose(const char *fmt, ...) {
-    if (verbose) {
-        if (logfile && log_line_count < LOG_LINE_LIMIT) {
-            va_list args;
-            va_start(args, fmt);
-            vfprintf(logfile, fmt, args);
-            va_end(args);
-            fflush(logfile);
-            log_line_count++;
-        }
-        
-        // Print to stdout only in verbose mode
-        va_list args;
-        va_start(args, fmt);
-        vprintf(fmt, args);
-        va_end(args);
-        fflush(stdout);
-    }
+//Nearest-rank percentiles of a metric over every recorded lifetime; out[k] for pcts[k]
+void lifePercentiles(double (*metric)(const LifeRecord *), const double *pcts, int n, double *out) {
+	for (int k = 0; k < n; k++) out[k] = 0.0;
+	if (lifeCount == 0) return;
+	double *values = malloc(lifeCount * sizeof(double));
+	if (values == NULL) return;
+	for (int r = 0; r < lifeCount; r++) values[r] = metric(&lifeRecords[r]);
+	qsort(values, lifeCount, sizeof(double), compareDouble);
+	for (int k = 0; k < n; k++) {
+		int rank = (int)(pcts[k] * lifeCount + 0.999999);
+		if (rank < 1) rank = 1;
+		if (rank > lifeCount) rank = lifeCount;
+		out[k] = values[rank - 1];
+	}
+	free(values);
 }
 
-//Helper to print resource table
-void printResourceTable() {
+double lifeTurnaround(const LifeRecord *rec) {
+	return rec->turnaroundMs;
+}
+
+double lifeBlockedFraction(const LifeRecord *rec) {
+	return rec->turnaroundMs ? (double)rec->blockedMs / rec->turnaroundMs : 0.0;
+}
+
+//Lifecycle totals used by the report and the JSON
+typedef struct {
+	int byCause[EXIT_CAUSES];
+	long long turnaroundMs;
+	long long blockedMs;
+	long long serviceMs;
+	long long lostMs; //lifetimes ended by a deadlock kill
+	long long lostInstanceMs;
+	double turnaround[4]; //p50, p90, p99, max
+	double blockedFraction[4];
+} LifeSummary;
+
+const double lifePcts[4] = {0.5, 0.9, 0.99, 1.0};
+
+void summarizeLifecycles(LifeSummary *sum) {
+	memset(sum, 0, sizeof(LifeSummary));
+	for (int r = 0; r < lifeCount; r++) {
+		const LifeRecord *rec = &lifeRecords[r];
+		sum->byCause[rec->cause]++;
+		sum->turnaroundMs += rec->turnaroundMs;
+		sum->blockedMs += rec->blockedMs;
+		sum->serviceMs += rec->serviceMs;
+		if (rec->cause == EXIT_DEADLOCK_KILL) {
+			sum->lostMs += rec->turnaroundMs;
+			sum->lostInstanceMs += rec->instanceMs;
+		}
+	}
+	lifePercentiles(lifeTurnaround, lifePcts, 4, sum->turnaround);
+	lifePercentiles(lifeBlockedFraction, lifePcts, 4, sum->blockedFraction);
+}
+
+void printLifecycleReport() {
 	char buffer[1024] = {0};
 	int offset = 0;
+	LifeSummary sum;
+	summarizeLifecycles(&sum);
 
 	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-			"Current system resources (available/total):\n");
-		
-	for (int i = 0; i < NUM_RESOURCES && offset < sizeof(buffer); i++) {
-		//Ensure resource ID is valid
-		if (i < 0 || i >= NUM_RESOURCES) continue;
-
-		//Get available instances with bounds checking
-		int avail = available[i];
-		if (avail < 0) avail = 0;
-		if (avail > NUM_INSTANCES) avail = NUM_INSTANCES;
-
-		// Format each resource entry
-		offset += snprintf(buffer + offset, sizeof(buffer) - offset, 
-				"R%-2d: %2d/%-2d  ", i, avail, NUM_INSTANCES);
+		"==== Worker Lifecycles ====\n"
+		"Workers: %d (", lifeCount);
+	for (int c = 0; c < EXIT_CAUSES; c++) {
+		offset += snprintf(buffer + offset, sizeof(buffer) - offset, "%s%d %s", c ? ", " : "", sum.byCause[c], exitCauseNames[c]);
 	}
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+		")%s\n"
+		"Turnaround p50/p90/p99/max: %.0f/%.0f/%.0f/%.0f ms\n"
+		"Blocked fraction p50/p90/p99/max: %.2f/%.2f/%.2f/%.2f, overall %.1f%% blocked, %.1f%% holding\n"
+		"Work lost to deadlock kills: %lld ms of worker time (%.1f%%), %lld instance-ms\n"
+		"===========================\n\n",
+		stat_life_records_dropped ? " (some lifetimes not recorded)" : "",
+		sum.turnaround[0], sum.turnaround[1], sum.turnaround[2], sum.turnaround[3],
+		sum.blockedFraction[0], sum.blockedFraction[1], sum.blockedFraction[2], sum.blockedFraction[3],
+		sum.turnaroundMs ? 100.0 * sum.blockedMs / sum.turnaroundMs : 0.0,
+		sum.turnaroundMs ? 100.0 * sum.serviceMs / sum.turnaroundMs : 0.0,
+		sum.lostMs, sum.turnaroundMs ? 100.0 * sum.lostMs / sum.turnaroundMs : 0.0,
+		sum.lostInstanceMs);
 
-	offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n");
-	
-	// Write the complete buffer to log
 	if (logfile) fprintf(logfile, "%s", buffer);
 	printf("%s", buffer);
 }
 
-// Helper to print process table
-void printProcessTable() {
-	char buffer[2048] = {0}; //Larger buffer for process table
-	int offset = 0;
+void noteDeparture(pid_t pid, int cause) {
+	if (departingCount == MAX_DEPARTING) {
+		departingCount--; //drop the oldest; its exit will show up as unannounced
+		memmove(&departing[0], &departing[1], departingCount * sizeof(Departure));
+	}
+	departing[departingCount].pid = pid;
+	departing[departingCount].cause = cause;
+	departingCount++;
+}
+
+void releaseAllAndRemove(int processIndex);
+
+//Attribute a reaped child to an exit cause, and free its slot if it never said goodbye
+void accountChildExit(pid_t childPid, int status, bool shuttingDown) {
+	if (federatedPartitions > 0 && accountPartitionExit(childPid, status, shuttingDown)) {
+		return;
+	}
+	purgeRepliesTo(childPid); //nobody will ever read these
+	for (int d = 0; d < departingCount; d++) {
+		if (departing[d].pid != childPid) continue;
+		if (departing[d].cause == EXIT_DEADLOCK_KILL) {
+			stat_exits_deadlock_killed++;
+		} else {
+			stat_normal_terminations++;
+		}
+		departing[d] = departing[--departingCount];
+		oss_log("OSS: Child process %d terminated\n", childPid);
+		return;
+	}
+
+	bool failed = (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+	int cause = EXIT_UNANNOUNCED;
+	if (shuttingDown && !failed) cause = EXIT_SHUTDOWN;
+	else if (failed || WIFSIGNALED(status)) cause = EXIT_CRASHED;
+
+	int processIndex = findProcessIndex(childPid);
+	if (processIndex != -1) {
+		endLifecycle(processIndex, cause);
+		releaseAllAndRemove(processIndex); //reclaim what it held, it can't release it anymore
+	}
+	if (cause == EXIT_SHUTDOWN) {
+		stat_exits_at_shutdown++;
+	} else if (cause == EXIT_CRASHED) {
+		stat_exits_crashed++;
+		oss_log("OSS: Child process %d died unexpectedly (status %d)\n", childPid, status);
+	} else {
+		stat_exits_unannounced++;
+		oss_log("OSS: Child process %d exited without terminating\n", childPid);
+	}
+}
+
+void reapChildren() {
+	pid_t childPid;
+	int status;
+	while ((childPid = waitpid(-1, &status, WNOHANG)) > 0) {
+		accountChildExit(childPid, status, false);
+	}
+}
+
+void setup_signal_fd() {
+	sigset_t handled;
+	sigemptyset(&handled);
+	sigaddset(&handled, SIGCHLD);
+	sigaddset(&handled, SIGINT);
+	sigaddset(&handled, SIGTERM);
+	sigaddset(&handled, SIGHUP);
+	if (sigprocmask(SIG_BLOCK, &handled, &originalSigmask) == -1) {
+		perror("sigprocmask");
+		exit(1);
+	}
+	sigfd = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sigfd == -1) {
+		perror("signalfd");
+		exit(1);
+	}
+}
+
+void sigint_handler(int sig);
+
+//Drain the signalfd: reap only when a child actually exited, shut down on SIGINT, SIGTERM or SIGHUP
+void handleSignalEvents() {
+	struct signalfd_siginfo info;
+	bool childExited = false;
+	int shutdownSignal = 0;
+	while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+		if (info.ssi_signo == SIGCHLD) {
+			childExited = true; //SIGCHLDs coalesce, so reap everything that's ready
+		} else {
+			shutdownSignal = info.ssi_signo;
+		}
+	}
+	if (childExited) {
+		reapChildren();
+	}
+	if (shutdownSignal) {
+		sigint_handler(shutdownSignal);
+	}
+}
+
+//Shutdown on SIGINT, SIGTERM or SIGHUP so our private IPC objects never outlive the run.
+//Called from the main loop via the signalfd, never in signal context.
+void sigint_handler(int sig) {
+	oss_log("OSS: Caught signal %d, cleaning up...\n", sig);
+
+	//kill all remanining user processes
+	for (int i = 0; i < 18; i++) {
+		if (processTable[i].pid != 0) {
+			kill(processTable[i].pid, SIGTERM);
+		}
+	}
+
+	//clean up shared memory, message queue and logfile
+	cleanup_shared_memory();
+
+	exit(1);
+}
+
+//Function to check if the system is in a safe state
+bool cachedIsSafe(int processIndex, const int *request);
+bool legacyClaimsWouldDeny(int processIndex, const int *request);
+void countLegacyDenial(int processIndex, const int *request);
+bool grantIsSafe(int processIndex, const int *request);
+
+// Function to initialize the resource table
+void initializeResourceTable() {
+	for (int i = 0; i < NUM_RESOURCES; i++) {
+		resourceTable[i].totalInstances = NUM_INSTANCES;
+		resourceTable[i].availableInstances = NUM_INSTANCES;
+		for (int j = 0; j < 18; j++) {
+			resourceTable[i].allocated[j] = 0;
+		}
+	}
+}
+
+//Empty process table and every resource free, with the views derived from them rebuilt.
+//Used at startup and by the fuzzer (-Z) before each run.
+void initAllocatorTables() {
+	memset(processTable, 0, sizeof(processTable));
+	memset(allocation, 0, sizeof(allocation));
+	memset(heldCount, 0, sizeof(heldCount));
+	memset(heldTotal, 0, sizeof(heldTotal));
+	memset(leaseUnclaimed, 0, sizeof(leaseUnclaimed));
+	memset(leaseUnclaimedTotal, 0, sizeof(leaseUnclaimedTotal));
+	memset(heldPos, 0, sizeof(heldPos));
+	memset(holderCount, 0, sizeof(holderCount));
+	memset(holderPos, 0, sizeof(holderPos));
+	initializeResourceTable();
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		available[j] = NUM_INSTANCES;
+		for (int i = 0; i < 18; i++) {
+			max[i][j] = DEFAULT_MAX_CLAIM; //until the worker declares its own claim
+			need[i][j] = max[i][j];
+		}
+	}
+	initStateHash();
+	initPackedState();
+}
+
+//Grant a whole request vector atomically: all of it or nothing, with one safety check
+int handleVectorRequest(int pid, const int *counts) {
+	int processIndex = findProcessIndex(pid);
+	if (processIndex == -1) {
+		oss_log("OSS Warning: Received message from dead process %d\n", pid);
+		return -1; //Process not found
+	}
+
+	//Check if enough resources available
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (available[j] < counts[j]) {
+			return 0; //can't grant
+		}
+	}
+
+	//Check if the request can be granted safely
+	if (grantIsSafe(processIndex, counts)) {
+		applyGrant(processIndex, counts);
+		return 1; //Granted
+	} else {
+		return 0; //Denied (unsafe state)
+	}
+}
+
+//Move a granted request vector into the process's allocation
+void applyGrant(int processIndex, const int *counts) {
+	lifeGranted(processIndex);
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (counts[j] == 0) continue;
+		resourceProfile[j].grants++;
+		setAvailable(j, available[j] - counts[j]);
+		setAllocation(processIndex, j, allocation[processIndex][j] + counts[j]); //update allocation and need
+		oss_log_verbose("OSS: Process %d requesting %d of resource %d\n", processTable[processIndex].pid, counts[j], j);
+	}
+	if (oracleEnabled) oracleGrant(processIndex, counts);
+}
+
+//Return up to counts[j] instances of each resource from a live process. Returns instances released.
+int releaseInstances(int processIndex, const int *counts) {
+	int released = 0;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		int n = counts[j];
+		if (n > allocation[processIndex][j]) n = allocation[processIndex][j];
+		if (n <= 0) continue;
+		setAvailable(j, available[j] + n);
+		setAllocation(processIndex, j, allocation[processIndex][j] - n);
+		released += n;
+	}
+	if (released > 0) waitQueueDirty = true;
+	if (oracleEnabled) oracleRelease(processIndex, counts);
+	return released;
+}
+
+//Reclaim everything a process holds and free its slot
+void releaseAllAndRemove(int processIndex) {
+	pid_t pid = processTable[processIndex].pid;
+	reclaimAllocation(processIndex);
+	setSlotPid(processIndex, 0);
+	removeProcessFromWaitQueue(pid);
+	waitQueueDirty = true;
+}
+
+//Outbound replies. Sends never block: if the queue is full the reply waits in the outbox, in order,
+//and is retried every loop iteration. Replies to workers that have been reaped are purged.
+#define REPLY_OUTBOX_INITIAL 256
+
+typedef struct {
+	pid_t pid;
+	int status;
+	int resourceId;
+} OutboundReply;
+
+OutboundReply *replyOutbox = NULL; //ring buffer, doubled when full
+int outboxCapacity = 0;
+int outboxHead = 0;
+int outboxCount = 0;
+int stat_replies_sent = 0;
+int stat_replies_deferred = 0; //queue was full, so the reply went to the outbox
+int stat_outbox_growths = 0; //outbox was full too, so it was doubled
+int stat_replies_purged = 0; //addressed to a reaped worker, dropped from the outbox or the queue
+int stat_max_outbox_depth = 0;
+int stat_max_queue_depth = 0; //sampled from msg_qnum
+
+//Try one non-blocking send. Returns 1 if sent, 0 if the queue is full, -1 on error.
+int trySendReply(const OutboundReply *reply) {
+	struct worker_message worker_response;
+	memset(&worker_response, 0, sizeof(worker_response));
+	worker_response.mtype = reply->pid; //Child's PID
+	worker_response.status = reply->status; //1 = success, 0 = deny, 2 = preempted
+	worker_response.resourceId = reply->resourceId;
+	if (msgsnd(msqid, &worker_response, sizeof(worker_response) - sizeof(long), IPC_NOWAIT) == -1) {
+		if (errno == EAGAIN) return 0;
+		perror("msgsnd (response to worker)");
+		return -1;
+	}
+	stat_replies_sent++;
+	return 1;
+}
+
+//Send what the queue will take, oldest first; stop at the first refusal to keep order, so a reply
+//leaves the outbox only once it was actually sent
+void flushOutbox() {
+	while (outboxCount > 0) {
+		if (trySendReply(&replyOutbox[outboxHead]) != 1) return;
+		outboxHead = (outboxHead + 1) % outboxCapacity;
+		outboxCount--;
+	}
+}
+
+//Double the outbox, unrolling the ring so the oldest reply lands at index 0
+bool growOutbox() {
+	int capacity = outboxCapacity ? outboxCapacity * 2 : REPLY_OUTBOX_INITIAL;
+	OutboundReply *grown = malloc(capacity * sizeof(OutboundReply));
+	if (grown == NULL) return false;
+	for (int k = 0; k < outboxCount; k++) {
+		grown[k] = replyOutbox[(outboxHead + k) % outboxCapacity];
+	}
+	if (replyOutbox != NULL) stat_outbox_growths++;
+	free(replyOutbox);
+	replyOutbox = grown;
+	outboxCapacity = capacity;
+	outboxHead = 0;
+	return true;
+}
+
+int sendReply(pid_t worker_pid, int status, int resourceId) {
+	OutboundReply reply = {worker_pid, status, resourceId};
+	flushOutbox();
+	if (outboxCount == 0) {
+		int sent = trySendReply(&reply);
+		if (sent != 0) return sent == 1 ? 0 : -1;
+	}
+	if (outboxCount == outboxCapacity) {
+		//Dropping a grant would strand the worker, and waiting for room could deadlock against workers
+		//blocked sending requests into the same queue, so make room instead
+		if (!growOutbox()) {
+			fprintf(stderr, "OSS: reply to %d lost, out of memory for the outbox\n", worker_pid);
+			return -1;
+		}
+	}
+	replyOutbox[(outboxHead + outboxCount) % outboxCapacity] = reply;
+	outboxCount++;
+	stat_replies_deferred++;
+	if (outboxCount > stat_max_outbox_depth) stat_max_outbox_depth = outboxCount;
+	return 0;
+}
+
+//Drop every reply meant for a worker that no longer exists, queued or already in the message queue
+void purgeRepliesTo(pid_t pid) {
+	int kept = 0;
+	for (int k = 0; k < outboxCount; k++) {
+		OutboundReply reply = replyOutbox[(outboxHead + k) % outboxCapacity];
+		if (reply.pid == pid) {
+			stat_replies_purged++;
+		} else {
+			replyOutbox[(outboxHead + kept) % outboxCapacity] = reply;
+			kept++;
+		}
+	}
+	outboxCount = kept;
+
+	struct worker_message stale;
+	while (msgrcv(msqid, &stale, sizeof(stale) - sizeof(long), pid, IPC_NOWAIT) != -1) {
+		stat_replies_purged++;
+	}
+}
+
+void sampleQueueDepth() {
+	struct msqid_ds info;
+	if (msgctl(msqid, IPC_STAT, &info) == 0 && (int)info.msg_qnum > stat_max_queue_depth) {
+		stat_max_queue_depth = (int)info.msg_qnum;
+	}
+}
+
+// Tell a worker that one instance of resourceId was taken back
+int send_preemption_to_worker(pid_t worker_pid, int resourceId) {
+	return sendReply(worker_pid, STATUS_PREEMPTED, resourceId);
+}
+
+// Function to send a message to a worker process
+int send_message_to_worker(pid_t worker_pid, int status) {
+	return sendReply(worker_pid, status, 0);
+}
+
+
+//Function to setup shared memory for the clock
+//The segment is IPC_PRIVATE (no key to collide on); workers get the id on their command line.
+int setup_shared_memory() {
+	shmid = shmget(IPC_PRIVATE, sizeof(SharedState), IPC_CREAT | IPC_EXCL | 0600);
+	if (shmid == -1) {
+		perror("shmget");
+		return 1;
+	}
+
+	sharedState = (SharedState *)shmat(shmid, NULL, 0);
+	if (sharedState == (SharedState *) -1) {
+		perror("shmat");
+		sharedState = NULL;
+		shmctl(shmid, IPC_RMID, NULL);
+		shmid = -1;
+		return 1;
+	}
+
+	//Mark for destruction right away; the segment lives until the last detach
+	shmctl(shmid, IPC_RMID, NULL);
+
+	//Initialize the ownership tag and the clock
+	sharedState->runId = runId;
+	sharedState->ownerPid = getpid();
+	sharedState->magic = OSS_SHM_MAGIC;
+	simClock = &sharedState->clock;
+	setSimClock(0);
+	sharedState->pacing.mode = pacingMode;
+	atomic_store(&sharedState->pacing.earliestNs, INT64_MAX);
+
+	return 0;
+}
+
+//Function to setup this run's private message queue
+int setup_message_queue() {
+	msqid = msgget(IPC_PRIVATE, IPC_CREAT | IPC_EXCL | 0600);
+	if (msqid == -1) {
+		perror("msgget");
+		return 1;
+	}
+	return 0;
+}
+
+//Function to clean up shared memory
+void cleanup_shared_memory() {
+	//Send SIGTERM to all active children
+	for (int i = 0; i < 18; i++) {
+		if (processTable[i].pid != 0) {
+            		kill(processTable[i].pid, SIGTERM);
+        	}
+	}
+	stopPartitions();
+	
+	//Wait for all children to exit
+	while (wait(NULL) > 0); //This ensures wait for all children
+
+	//if (simClock != (SimulatedClock *)-1) {
+	//	shmdt(simClock);
+	//}
+	//if (shmid != -1) {
+	//	shmctl(shmid, IPC_RMID, NULL); //Mark for destruction
+	//}
+
+	//Clean up IPC resources (only once, may be reached from atexit and a signal)
+	if (ipc_cleaned) return;
+	ipc_cleaned = 1;
+	if (sharedState != NULL) {
+		for (int p = 1; p < sharedState->federation.partitions; p++) {
+			if (sharedState->federation.msqid[p] != -1) msgctl(sharedState->federation.msqid[p], IPC_RMID, NULL);
+		}
+		shmdt(sharedState);
+		sharedState = NULL;
+	}
+	if (shmid != -1) {
+		shmctl(shmid, IPC_RMID, NULL);
+		shmid = -1;
+	}
+	if (msqid != -1) {
+		msgctl(msqid, IPC_RMID, NULL);
+		msqid = -1;
+	}
+
+	if (sigfd != -1) {
+		close(sigfd);
+		sigfd = -1;
+	}
+	closeControlChannel();
+
+	if (logfile) {
+		fclose(logfile);
+		logfile = NULL;
+	}
+}
+
+//Banker's safe-sequence search: can every live process finish, starting from work?
+//A finishing process returns its current holdings plus pendingGrant[i] (NULL if nothing is being granted to it).
+bool safeSequenceExists(int work[NUM_RESOURCES], int temp_need[18][NUM_RESOURCES], const int *pendingGrant[18]) {
+	bool finish[18]; //indicates if a process can finish
+
+	//Initialize finish (empty slots have nothing to finish)
+	int count = 0;
+	for (int i = 0; i < 18; i++) {
+		finish[i] = (processTable[i].pid == 0);
+		if (finish[i]) count++;
+	}
+
+	//Find a process that can finish
+	while (count < 18) {
+		bool found = false;
+		for (int i = 0; i < 18; i++) {
+			if (!finish[i]) {
+				bool canFinish = true;
+				for (int j = 0; j < NUM_RESOURCES; j++) {
+					if (temp_need[i][j] > work[j]) {
+						canFinish = false;
+						break;
+					}
+				}
+				if (canFinish) {
+					for (int k = 0; k < heldCount[i]; k++) {
+						int j = heldResources[i][k];
+						work[j] += allocation[i][j];
+					}
+					if (pendingGrant[i]) {
+						for (int j = 0; j < NUM_RESOURCES; j++) {
+							work[j] += pendingGrant[i][j];
+						}
+					}
+					finish[i] = true;
+					count++;
+					found = true;
+				}
+			}
+		}
+		if (!found) {
+			return false; //Unsafe state
+		}
+	}
+	return true; //Safe state
+}
+
+//Banker's safety check against a given need matrix, as if processIndex were granted the request vector
+bool isSafeWithNeed(int needMatrix[18][NUM_RESOURCES], int processIndex, const int *request) {
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (available[j] < request[j] || needMatrix[processIndex][j] < request[j]) {
+			return false; //Not enough available, or more than the process claimed
+		}
+	}
+
+	//The packed copy only mirrors the real need matrix; other matrices (legacy claims) take the generic path
+	bool kernelSafe = false;
+	if (safetyKernel != NULL && needMatrix == need) {
+		uint64_t packedNeedCopy[18];
+		uint64_t give[18];
+		memcpy(packedNeedCopy, packedNeed, sizeof(packedNeedCopy));
+		memcpy(give, packedAllocation, sizeof(give));
+		uint64_t packedRequest = pack_lanes(request, NUM_RESOURCES);
+		//Each lane of the request is at most its lane of available and of need, so nothing borrows
+		uint64_t work = pack_lanes(available, NUM_RESOURCES) - packedRequest;
+		packedNeedCopy[processIndex] -= packedRequest;
+		give[processIndex] += packedRequest;
+		kernelSafe = safetyKernel(work, packedNeedCopy, give, liveMask) == 0;
+		if (cacheMode != CACHE_VERIFY) {
+			return kernelSafe;
+		}
+	}
+
+	int work[NUM_RESOURCES]; //available resources
+	int temp_need[18][NUM_RESOURCES]; //temporary need matrix
+	const int *pendingGrant[18] = {NULL}; //allocation itself is read through the sparse view
+
+	//1. Initialize work and copy need
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		work[j] = available[j] - request[j]; //simulate the allocation
+	}
+	memcpy(temp_need, needMatrix, sizeof(temp_need));
+
+	//2. Simulate allocating the resource
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		temp_need[processIndex][j] -= request[j];
+	}
+	pendingGrant[processIndex] = request;
+
+	//3. Find a safe sequence
+	bool safe = safeSequenceExists(work, temp_need, pendingGrant);
+	if (safetyKernel != NULL && needMatrix == need && safe != kernelSafe) {
+		stat_kernel_verify_mismatches++;
+		oss_log("OSS: The %s safety kernel disagrees with the generic check for P%d\n", safetyKernelName, processIndex);
+	}
+	return safe;
+}
+
+
+//Set-associative verdict cache, keyed by stateHash mixed with the candidate (slot, request vector)
+#define SAFETY_CACHE_SETS 1024 //power of two
+#define SAFETY_CACHE_WAYS 4
+
+typedef struct {
+	uint64_t key;
+	uint32_t lastUse; //0 = empty
+	bool safe;
+} SafetyCacheEntry;
+
+SafetyCacheEntry safetyCache[SAFETY_CACHE_SETS][SAFETY_CACHE_WAYS];
+uint32_t safetyCacheTick = 0;
+int stat_cache_lookups = 0;
+int stat_cache_hits = 0;
+int stat_cache_evictions = 0;
+int stat_cache_verify_mismatches = 0; //verify mode: cached verdict or running hash disagreed with a recompute
+
+//Banker's check on the real need matrix, answered from the cache when this exact state was seen before
+bool cachedIsSafe(int processIndex, const int *request) {
+	if (cacheMode == CACHE_OFF) {
+		return isSafeWithNeed(need, processIndex, request);
+	}
+	if (cacheMode == CACHE_VERIFY && stateHash != computeStateHash()) {
+		stat_cache_verify_mismatches++;
+		oss_log("OSS: State hash drifted from the allocation matrix\n");
+		stateHash = computeStateHash();
+	}
+
+	uint64_t key = stateHash ^ zobristSlot[processIndex];
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (request[j] < 0 || request[j] > NUM_INSTANCES) {
+			return isSafeWithNeed(need, processIndex, request); //can't be keyed, and will be refused anyway
+		}
+		key ^= zobristRequest[j][request[j]];
+	}
+
+	stat_cache_lookups++;
+	SafetyCacheEntry *set = safetyCache[key & (SAFETY_CACHE_SETS - 1)];
+	int victim = 0;
+	for (int w = 0; w < SAFETY_CACHE_WAYS; w++) {
+		if (set[w].lastUse != 0 && set[w].key == key) {
+			stat_cache_hits++;
+			set[w].lastUse = ++safetyCacheTick;
+			if (cacheMode == CACHE_VERIFY && isSafeWithNeed(need, processIndex, request) != set[w].safe) {
+				stat_cache_verify_mismatches++;
+				oss_log("OSS: Cached safety verdict for P%d disagrees with a recompute\n", processIndex);
+			}
+			return set[w].safe;
+		}
+		if (set[w].lastUse < set[victim].lastUse) victim = w; //least recently used, empty ways first
+	}
+
+	bool safe = isSafeWithNeed(need, processIndex, request);
+	if (set[victim].lastUse != 0) stat_cache_evictions++;
+	set[victim].key = key;
+	set[victim].safe = safe;
+	set[victim].lastUse = ++safetyCacheTick;
+	return safe;
+}
+
+//Would the same grant have been refused if every process still claimed DEFAULT_MAX_CLAIM of everything?
+bool legacyClaimsWouldDeny(int processIndex, const int *request) {
+	int legacyNeed[18][NUM_RESOURCES];
+	for (int i = 0; i < 18; i++) {
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			legacyNeed[i][j] = DEFAULT_MAX_CLAIM - allocation[i][j];
+			if (legacyNeed[i][j] < 0) legacyNeed[i][j] = 0;
+		}
+	}
+	return !isSafeWithNeed(legacyNeed, processIndex, request);
+}
+
+//Count a granted request the legacy claims would have refused. This is a second full banker's pass that
+//only avoid and hybrid make, so it is timed on its own instead of as part of the decision.
+void countLegacyDenial(int processIndex, const int *request) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (legacyClaimsWouldDeny(processIndex, request)) {
+		stat_legacy_claim_denials++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	stat_legacy_wall_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+}
+
+//Is a banker's check needed under the current strategy and load?
+bool needsSafetyCheck() {
+	if (deadlockStrategy == STRATEGY_AVOID) return true;
+	if (deadlockStrategy == STRATEGY_DETECT) return false;
+
+	int allocated = 0;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		allocated += NUM_INSTANCES - available[j];
+	}
+	return allocated * 100 >= hybridThresholdPct * NUM_RESOURCES * NUM_INSTANCES;
+}
+
+//Strategy-aware grant decision for a request vector (availability was already checked)
+bool grantIsSafe(int processIndex, const int *request) {
+	if (!needsSafetyCheck()) {
+		stat_optimistic_grants++;
+		return true;
+	}
+	stat_safety_checks++;
+	bool safe = cachedIsSafe(processIndex, request);
+	if (oracleEnabled) oracleCheckDecision(1, &processIndex, request, safe);
+	if (!safe) {
+		return false;
+	}
+	countLegacyDenial(processIndex, request);
+	return true;
+}
+
+//Handle a worker's declared max claim vector. Returns 1 if accepted.
+int handleClaim(int pid, const int *claim) {
+	int processIndex = findProcessIndex(pid);
+	if (processIndex == -1) {
+		return 0;
+	}
+
+	//Leases are issued against the default claim before the worker declares its own; an unclaimed
+	//lease isn't held yet, so take it back rather than reject a claim below it
+	if (leasesOutstanding) {
+		int below[NUM_RESOURCES] = {0};
+		bool any = false;
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			if (claim[j] < allocation[processIndex][j]) below[j] = any = true;
+		}
+		int returned = any ? revokeLeases(processIndex, below) : 0;
+		if (returned > 0) {
+			stat_lease_instances_revoked += returned;
+			waitQueueDirty = true;
+		}
+	}
+
+	int total = 0;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		//A claim must fit in the system and cover what the process already holds
+		if (claim[j] < allocation[processIndex][j] || claim[j] > NUM_INSTANCES) {
+			oss_log("OSS: Rejecting claim of process %d: %d of R%d\n", pid, claim[j], j);
+			stat_claims_rejected++;
+			return 0;
+		}
+		total += claim[j];
+	}
+	if (total == 0) {
+		oss_log("OSS: Rejecting empty claim of process %d\n", pid);
+		stat_claims_rejected++;
+		return 0;
+	}
+
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		//A smaller claim leaves less outstanding need, which can make a blocked request safe
+		if (claim[j] < max[processIndex][j]) waitQueueDirty = true;
+		setMaxClaim(processIndex, j, claim[j]);
+	}
+	if (federatedPartitions > 0) {
+		//The other partitions serve this worker's requests for their resources against the same claim
+		PublishedClaim *published = &sharedState->federation.claims[processIndex];
+		memcpy(published->claim, claim, sizeof(published->claim));
+		published->pid = pid;
+	}
+	stat_claims_accepted++;
+	oss_log_verbose("OSS: Process %d declared a max claim of %d instances\n", pid, total);
+	return 1;
+}
+
+//Break a deadlock by moving one instance from a deadlocked holder to a deadlocked waiter.
+//Picks the holder with the fewest instances so the least progress is lost. Returns false if
+//no single instance can be moved, in which case the caller falls back to killing.
+bool preemptOneInstance(const int *deadlocked, int deadlockedCount) {
+	bool isDeadlocked[18] = {false};
+	for (int k = 0; k < deadlockedCount; k++) {
+		isDeadlocked[deadlocked[k]] = true;
+	}
+
+	int bestWait = -1, bestVictim = -1, bestHeld = 0;
+	for (int w = 0; w < waitQueueSize; w++) {
+		int waiter = findProcessIndex(waitQueue[w].pid);
+		//Vector requests may need more than one instance moved; leave those to the kill fallback
+		if (waiter == -1 || !isDeadlocked[waiter] || waitQueue[w].resourceId < 0) continue;
+		int r = waitQueue[w].resourceId;
+		for (int h = 0; h < holderCount[r]; h++) {
+			int v = holders[r][h];
+			if (v == waiter || !isDeadlocked[v]) continue;
+			int held = heldTotal[v];
+			//Ties go to the lowest slot, whatever order the holder list is in
+			if (bestVictim == -1 || held < bestHeld || (held == bestHeld && w == bestWait && v < bestVictim)) {
+				bestWait = w;
+				bestVictim = v;
+				bestHeld = held;
+			}
+		}
+	}
+	if (bestVictim == -1) return false;
+
+	WaitQueueEntry entry = waitQueue[bestWait];
+	int waiter = findProcessIndex(entry.pid);
+	int r = entry.resourceId;
+	pid_t victimPid = processTable[bestVictim].pid;
+
+	//Revoke from the victim; it keeps running and may ask for it again later
+	setAllocation(bestVictim, r, allocation[bestVictim][r] - 1);
+	send_preemption_to_worker(victimPid, r);
+	stat_preemptions++;
+
+	//Hand it straight to the waiter so the victim can't win it back first
+	setAllocation(waiter, r, allocation[waiter][r] + 1);
+	if (oracleEnabled) oracleMove(bestVictim, waiter, r);
+	resourceProfile[r].grants++;
+	removeFromWaitQueue(bestWait);
+	send_message_to_worker(entry.pid, STATUS_GRANTED);
+	countGrant(true);
+	stat_wait_total_ns += simTimeNs() - entry.enqueueNs;
+	lifeGranted(waiter);
+	lifeUnblocked(waiter, entry.enqueueNs);
+
+	oss_log("OSS: Preempted one instance of R%d from P%d (PID %d) and granted it to P%d (PID %d)\n",
+			r, bestVictim, victimPid, waiter, entry.pid);
+	return true;
+}
+
+//Deadlock detection and recovery
+//Kill process idx to break a deadlock and take back everything it held
+void killDeadlockVictim(int idx) {
+	pid_t pid = processTable[idx].pid;
+	endLifecycle(idx, EXIT_DEADLOCK_KILL);
+	//Release all resources held by this process
+	reclaimAllocation(idx);
+	waitQueueDirty = true;
+
+	//Remove from process table
+	setSlotPid(idx, 0);
+	//Remove from wait queue if present
+	removeProcessFromWaitQueue(pid);
+	//send SIGTERM to the process
+	noteDeparture(pid, EXIT_DEADLOCK_KILL);
+	kill(pid, SIGTERM);
+	stat_deadlock_terminations++;
+	stat_deadlock_processes_terminated++;
+}
+
+void detectAndResolveDeadlock() {
+	stat_deadlock_detection_runs++;
+	if (federatedPartitions > 0) {
+		//No partition sees the whole wait-for graph; gather it from all of them instead
+		federationDetect();
+		return;
+	}
+	bool finish[18];
+	int work[NUM_RESOURCES];
+	int temp_request[18][NUM_RESOURCES]; //outstanding (blocked) requests, not max claims; valid where blocked[i]
+	bool blocked[18] = {false};
+	int deadlocked[18];
+	int deadlockedCount = 0;
+
+	//Initialize work and finish
+	for (int i = 0; i < NUM_RESOURCES; i++) {
+		work[i] = available[i];
+	}
+	for (int i = 0; i < 18; i++) {
+		finish[i] = (processTable[i].pid == 0); //true if no process
+		deadlocked[i] = 0;
+	}
+	//Only blocked processes can be part of a deadlock
+	for (int w = 0; w < waitQueueSize; w++) {
+		int idx = findProcessIndex(waitQueue[w].pid);
+		if (idx != -1) {
+			if (!blocked[idx]) {
+				memset(temp_request[idx], 0, sizeof(temp_request[idx]));
+				blocked[idx] = true;
+			}
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				temp_request[idx][j] += waitQueue[w].counts[j];
+			}
+		}
+	}
+
+	//Blocked processes need their outstanding request, the rest can always finish
+	uint32_t kernelStuck = 0;
+	if (safetyKernel != NULL) {
+		uint64_t packedRequest[18] = {0};
+		for (int i = 0; i < 18; i++) {
+			if (blocked[i]) packedRequest[i] = pack_lanes(temp_request[i], NUM_RESOURCES);
+		}
+		kernelStuck = safetyKernel(pack_lanes(available, NUM_RESOURCES), packedRequest, packedAllocation, liveMask);
+		if (cacheMode != CACHE_VERIFY) {
+			for (int i = 0; i < 18; i++) {
+				finish[i] = !(kernelStuck >> i & 1);
+			}
+		}
+	}
+
+	//Try to find a sequence where all can finish
+	bool progress = safetyKernel == NULL || cacheMode == CACHE_VERIFY;
+	while (progress) {
+		progress = false;
+		for (int i = 0; i < 18; i++) {
+			if (!finish[i]) {
+				bool canFinish = true;
+				for (int j = 0; blocked[i] && j < NUM_RESOURCES; j++) {
+					if (temp_request[i][j] > work[j]) {
+						canFinish = false;
+						break;
+					}
+				}
+				if (canFinish) {
+					for (int k = 0; k < heldCount[i]; k++) {
+						int j = heldResources[i][k];
+						work[j] += allocation[i][j];
+					}
+					finish[i] = true;
+					progress = true;
+				}
+			}
+		}
+	}
+
+	//Any process not finished is deadlocked
+	for (int i = 0; i < 18; i++) {
+		if (!finish[i] && processTable[i].pid != 0) {
+			deadlocked[deadlockedCount++] = i;
+		}
+		if (safetyKernel != NULL && cacheMode == CACHE_VERIFY && finish[i] == (kernelStuck >> i & 1)) {
+			stat_kernel_verify_mismatches++;
+			oss_log("OSS: The %s safety kernel disagrees with deadlock detection on P%d\n", safetyKernelName, i);
+		}
+	}
+	if (oracleEnabled) oracleCheckDetection(deadlocked, deadlockedCount);
+
+	if (deadlockedCount == 0) {
+		oss_log("OSS: Deadlock detection: No deadlocks detected at time %u:%u\n", simClock->seconds, simClock->nanoseconds);
+		return;
+	}
+
+	oss_log("OSS: Deadlock detected at time %u:%u. Deadlocked processes:", simClock->seconds, simClock->nanoseconds);
+	for (int i = 0; i < deadlockedCount; i++) {
+		oss_log(" P%d", deadlocked[i]);
+	}
+	oss_log("\n");
+
+	if (recoveryMode == RECOVERY_PREEMPT && preemptOneInstance(deadlocked, deadlockedCount)) {
+		oss_log("OSS: Re-running deadlock detection after preemption\n");
+		detectAndResolveDeadlock();
+		return;
+	}
+
+	//Termiante deadlocked processes one by one until deadlock is resolved
+	for (int k = 0; k < deadlockedCount; k++) {
+		int idx = deadlocked[k];
+		oss_log("OSS: Terminating process P%d (PID %d) to resolve deadlock\n", idx, processTable[idx].pid);
+		killDeadlockVictim(idx);
+		//After terminating one, re-run detection to see if deadlock is resolved
+		oss_log("OSS: Re-running deadlock detection after terminating P%d\n", idx);
+		detectAndResolveDeadlock();
+		break; // only termiante one at a time, then re-check
+	}
+}
+
+//Logging helper function
+void oss_log(const char *fmt, ...) {
+	if (logMuted) return;
+	if (logfile && log_line_count < LOG_LINE_LIMIT) {
+        va_list args;
+        va_start(args, fmt);
+        vfprintf(logfile, fmt, args);
+        va_end(args);
+        fflush(logfile);
+        log_line_count++;
+    }
+    
+    // Always print to stdout
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    fflush(stdout);
+}
+
+void oss_log_verbose(const char *fmt, ...) {
+    if (verbose && !logMuted) {
+        if (logfile && log_line_count < LOG_LINE_LIMIT) {
+            va_list args;
+            va_start(args, fmt);
+            vfprintf(logfile, fmt, args);
+            va_end(args);
+            fflush(logfile);
+            log_line_count++;
+        }
+        
+        // Print to stdout only in verbose mode
+        va_list args;
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+        fflush(stdout);
+    }
+}
+
+//Helper to print resource table
+void printResourceTable() {
+	char buffer[1024] = {0};
+	int offset = 0;
+
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+			"Current system resources (available/total):\n");
+		
+	for (int i = 0; i < NUM_RESOURCES && offset < sizeof(buffer); i++) {
+		//Ensure resource ID is valid
+		if (i < 0 || i >= NUM_RESOURCES) continue;
+
+		//Get available instances with bounds checking
+		int avail = available[i];
+		if (avail < 0) avail = 0;
+		if (avail > NUM_INSTANCES) avail = NUM_INSTANCES;
+
+		// Format each resource entry
+		offset += snprintf(buffer + offset, sizeof(buffer) - offset, 
+				"R%-2d: %2d/%-2d  ", i, avail, NUM_INSTANCES);
+	}
+
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n");
+	
+	// Write the complete buffer to log
+	if (logfile) fprintf(logfile, "%s", buffer);
+	printf("%s", buffer);
+}
+
+// Helper to print process table
+void printProcessTable() {
+	char buffer[2048] = {0}; //Larger buffer for process table
+	int offset = 0;
+
+	//Print header
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset, 
+					  "Current process allocations:\n  ");
+
+	//Print resource IDs header
+	for (int i = 0; i < NUM_RESOURCES && offset < sizeof(buffer); i++) {
+		offset += snprintf(buffer + offset, sizeof(buffer) - offset, "R%-2d ", i);
+	}
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n");
+
+	//Print process allocations
+	for (int i = 0; i < 18 && offset < sizeof(buffer); i++) {
+		if (processTable[i].pid != 0) {
+			offset += snprintf(buffer + offset, sizeof(buffer) - offset, "P%-2d ", i);
+
+			//Expand the sparse row; everything not listed is zero
+			int row[NUM_RESOURCES] = {0};
+			for (int k = 0; k < heldCount[i]; k++) {
+				row[heldResources[i][k]] = allocation[i][heldResources[i][k]];
+			}
+			for (int j = 0; j < NUM_RESOURCES && offset < sizeof(buffer); j++) {
+				// Validate allocation value
+				int alloc = row[j];
+				if (alloc < 0) alloc = 0;
+				if (alloc > NUM_INSTANCES) alloc = NUM_INSTANCES;
+				
+				offset += snprintf(buffer + offset, sizeof(buffer) - offset, "%2d  ", alloc);
+			}
+			offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n");
+		}
+	}
+
+	//Write the complete buffer to log
+	if (logfile) fprintf(logfile, "%s", buffer);
+	printf("%s", buffer);
+}
+
+//Per-resource contention report, hottest resources first
+void printResourceProfile() {
+	char buffer[2048] = {0};
+	int offset = 0;
+	long long now = simTimeNs();
+
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+		"==== Resource Contention ====\n"
+		"Res  Reqs  Grants  Wait(unavail/unsafe)  Claim-denied  Hold mean/p50/p90/max ms  Util   Queue\n");
+	for (int j = 0; j < NUM_RESOURCES && offset < sizeof(buffer); j++) {
+		ResourceProfile *prof = &resourceProfile[j];
+		offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+			"R%-2d  %4d  %6d  %8d/%-8d    %12d  %6.1f/%4.0f/%4.0f/%6.1f  %4.0f%%  %5.2f\n",
+			j, prof->requests, prof->grants, prof->waitsUnavailable, prof->waitsUnsafe, prof->deniedClaim,
+			prof->holds ? prof->holdTotalNs / 1e6 / prof->holds : 0.0,
+			holdPercentileMs(prof, 0.5), holdPercentileMs(prof, 0.9), prof->holdMaxNs / 1e6,
+			100.0 * profileUtilization(prof, now), profileMeanQueueDepth(prof, now));
+	}
+
+	//Hottest: most requests that had to wait, then highest utilization
+	bool picked[NUM_RESOURCES] = {false};
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset, "Hottest resources:");
+	for (int n = 0; n < PROFILE_TOP_N && n < NUM_RESOURCES; n++) {
+		int best = -1;
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			if (picked[j]) continue;
+			if (best == -1) { best = j; continue; }
+			int waits = resourceProfile[j].waitsUnavailable + resourceProfile[j].waitsUnsafe;
+			int bestWaits = resourceProfile[best].waitsUnavailable + resourceProfile[best].waitsUnsafe;
+			if (waits > bestWaits || (waits == bestWaits &&
+					profileUtilization(&resourceProfile[j], now) > profileUtilization(&resourceProfile[best], now))) {
+				best = j;
+			}
+		}
+		picked[best] = true;
+		offset += snprintf(buffer + offset, sizeof(buffer) - offset, " R%d", best);
+	}
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n=============================\n\n");
+
+	if (logfile) fprintf(logfile, "%s", buffer);
+	printf("%s", buffer);
+}
+
+// Helper to print statistics
+void printStatistics() {
+	char buffer[3072] = {0};
+	int offset = 0;
+	double simSeconds = simClock->seconds + simClock->nanoseconds / 1e9;
+	char ossCpuText[16] = "any";
+	char cpuList[512];
+	if (ossCpu != -1) snprintf(ossCpuText, sizeof(ossCpuText), "%d", ossCpu);
+	formatCpuList(cpuList, sizeof(cpuList));
+
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+		"\n==== Simulation Statistics ====\n"
+		"Requests granted immediately: %d\n"
+		"Requests granted after waiting: %d\n"
+		"Processes terminated by deadlock: %d\n"
+		"Processes terminated normally: %d\n"
+		"Other exits: %d reaped after deadlock kill, %d crashed, %d unannounced, %d at shutdown\n"
+		"Deadlock detection runs: %d\n"
+		"Processes terminated per deadlock event: %d\n"
+		"Launches delayed/rejected/early by admission control: %d/%d/%d\n"
+		"Wait queue policy: %s, mean wait: %.3f ms\n"
+		"Claims accepted/rejected: %d/%d, grants the fixed claims would have denied: %d\n"
+		"Deadlock strategy: %s, safety checks: %d, optimistic grants: %d\n"
+		"Deadlock recovery: %s, instances preempted: %d\n"
+		"Throughput: %.2f grants per simulated second, mean decision time: %.0f ns\n"
+		"Request batches: %d (mean %.2f, max %d requests), batch splits: %d\n"
+		"Safety cache (%s): %d lookups, %.1f%% hits, %d evictions, %d verify mismatches\n"
+		"Safety kernel: %s, %d verify mismatches\n"
+		"Replies: %d sent, %d deferred (max outbox %d, grown %d times), %d purged, max queue depth %d\n"
+		"Leases (%d per resource): %d instances issued, %d revoked, %d fast grants, %d reconcile passes\n"
+		"Checkpoint: %d ticks deferred, %d workers re-spawned from a restore\n"
+		"Placement: oss on CPU %s, workers %s over CPUs %s\n"
+		"Pacing: %s, %d sleeper wakeups, %lld simulated ms fast-forwarded\n"
+		"Event polls: %d made, %d skipped while busy\n"
+		"Federation: %d partitions, %d deadlock victims across partitions\n"
+		"Reference oracle (%s): %d events, %d decisions checked, %d divergences\n"
+		"===============================\n\n",
+		stat_requests_granted_immediately,
+		stat_requests_granted_after_wait,
+		stat_deadlock_terminations,
+		stat_normal_terminations,
+		stat_exits_deadlock_killed,
+		stat_exits_crashed,
+		stat_exits_unannounced,
+		stat_exits_at_shutdown,
+		stat_deadlock_detection_runs,
+		stat_deadlock_processes_terminated,
+		stat_admission_delays,
+		stat_admission_rejects,
+		stat_admission_fast_launches,
+		policyNames[waitPolicy],
+		stat_requests_granted_after_wait ? stat_wait_total_ns / 1e6 / stat_requests_granted_after_wait : 0.0,
+		stat_claims_accepted,
+		stat_claims_rejected,
+		stat_legacy_claim_denials,
+		strategyNames[deadlockStrategy],
+		stat_safety_checks,
+		stat_optimistic_grants,
+		recoveryNames[recoveryMode],
+		stat_preemptions,
+		simSeconds > 0 ? (stat_requests_granted_immediately + stat_requests_granted_after_wait) / simSeconds : 0.0,
+		stat_decisions ? (double)stat_decision_wall_ns / stat_decisions : 0.0,
+		stat_batches,
+		stat_batches ? (double)stat_batched_requests / stat_batches : 0.0,
+		stat_max_batch,
+		stat_batch_splits,
+		cacheModeNames[cacheMode],
+		stat_cache_lookups,
+		stat_cache_lookups ? 100.0 * stat_cache_hits / stat_cache_lookups : 0.0,
+		stat_cache_evictions,
+		stat_cache_verify_mismatches,
+		safetyKernelName,
+		stat_kernel_verify_mismatches,
+		stat_replies_sent,
+		stat_replies_deferred,
+		stat_max_outbox_depth,
+		stat_outbox_growths,
+		stat_replies_purged,
+		stat_max_queue_depth,
+		leaseSize,
+		stat_lease_instances_issued,
+		stat_lease_instances_revoked,
+		sharedState ? atomic_load(&sharedState->leases.fastGrants) : 0,
+		stat_lease_reconciles,
+		stat_checkpoint_deferrals,
+		stat_workers_respawned,
+		ossCpuText,
+		placementNames[workerPlacement],
+		cpuList,
+		pacingNames[pacingMode],
+		stat_pacing_wakeups,
+		stat_fast_forward_ms,
+		stat_event_polls,
+		stat_event_polls_skipped,
+		federatedPartitions,
+		stat_federation_kills,
+		oracleEnabled ? "on" : "off",
+		stat_oracle_events,
+		stat_oracle_decisions,
+		stat_oracle_divergences);
+
+	// Write the complete buffer to log
+	if (logfile) fprintf(logfile, "%s", buffer);
+	printf("%s", buffer);
+}
+
+//Write a user-supplied string as a JSON string literal, escaping quotes, backslashes and control characters
+void writeJsonString(FILE *fp, const char *str) {
+	fputc('"', fp);
+	for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\') fprintf(fp, "\\%c", *c);
+		else if (*c < 0x20) fprintf(fp, "\\u%04x", *c);
+		else fputc(*c, fp);
+	}
+	fputc('"', fp);
+}
+
+// Write final statistics as one flat JSON object (read by the sweep runner)
+int writeStatisticsJson(const char *path) {
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		perror("fopen stats");
+		return -1;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double wall_ms = (now.tv_sec - run_start_wall.tv_sec) * 1000.0 +
+		(now.tv_nsec - run_start_wall.tv_nsec) / 1000000.0;
+	double simSeconds = simClock->seconds + simClock->nanoseconds / 1e9;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"run_id\": %u,\n", runId);
+	fprintf(fp, "  \"max_processes\": %d,\n", maxProcesses);
+	fprintf(fp, "  \"launch_interval_ms\": %d,\n", launchIntervalMs);
+	fprintf(fp, "  \"workload\": ");
+	writeJsonString(fp, workloadProfile ? workloadProfile : "default");
+	fprintf(fp, ",\n");
+	fprintf(fp, "  \"max_runtime_seconds\": %d,\n", maxRuntimeSeconds);
+	fprintf(fp, "  \"sim_time_s\": %.9f,\n", simClock->seconds + simClock->nanoseconds / 1e9);
+	fprintf(fp, "  \"wall_time_ms\": %.3f,\n", wall_ms);
+	fprintf(fp, "  \"processes_launched\": %d,\n", stat_processes_launched);
+	fprintf(fp, "  \"admission_delays\": %d,\n", stat_admission_delays);
+	fprintf(fp, "  \"admission_rejects\": %d,\n", stat_admission_rejects);
+	fprintf(fp, "  \"admission_fast_launches\": %d,\n", stat_admission_fast_launches);
+	fprintf(fp, "  \"requests_granted_immediately\": %d,\n", stat_requests_granted_immediately);
+	fprintf(fp, "  \"requests_granted_after_wait\": %d,\n", stat_requests_granted_after_wait);
+	fprintf(fp, "  \"wait_policy\": \"%s\",\n", policyNames[waitPolicy]);
+	fprintf(fp, "  \"mean_wait_ms\": %.6f,\n",
+		stat_requests_granted_after_wait ? stat_wait_total_ns / 1e6 / stat_requests_granted_after_wait : 0.0);
+	fprintf(fp, "  \"claims_accepted\": %d,\n", stat_claims_accepted);
+	fprintf(fp, "  \"claims_rejected\": %d,\n", stat_claims_rejected);
+	fprintf(fp, "  \"legacy_claim_denials\": %d,\n", stat_legacy_claim_denials);
+	fprintf(fp, "  \"legacy_check_wall_ns\": %lld,\n", stat_legacy_wall_ns);
+	fprintf(fp, "  \"deadlock_strategy\": \"%s\",\n", strategyNames[deadlockStrategy]);
+	fprintf(fp, "  \"safety_checks\": %d,\n", stat_safety_checks);
+	fprintf(fp, "  \"optimistic_grants\": %d,\n", stat_optimistic_grants);
+	fprintf(fp, "  \"grants_per_sim_second\": %.6f,\n", simSeconds > 0 ?
+		(stat_requests_granted_immediately + stat_requests_granted_after_wait) / simSeconds : 0.0);
+	fprintf(fp, "  \"mean_decision_ns\": %.1f,\n", stat_decisions ? (double)stat_decision_wall_ns / stat_decisions : 0.0);
+	fprintf(fp, "  \"request_batches\": %d,\n", stat_batches);
+	fprintf(fp, "  \"mean_batch_size\": %.4f,\n", stat_batches ? (double)stat_batched_requests / stat_batches : 0.0);
+	fprintf(fp, "  \"max_batch_size\": %d,\n", stat_max_batch);
+	fprintf(fp, "  \"batch_splits\": %d,\n", stat_batch_splits);
+	fprintf(fp, "  \"safety_cache\": \"%s\",\n", cacheModeNames[cacheMode]);
+	fprintf(fp, "  \"cache_lookups\": %d,\n", stat_cache_lookups);
+	fprintf(fp, "  \"cache_hits\": %d,\n", stat_cache_hits);
+	fprintf(fp, "  \"cache_hit_rate\": %.4f,\n", stat_cache_lookups ? (double)stat_cache_hits / stat_cache_lookups : 0.0);
+	fprintf(fp, "  \"cache_evictions\": %d,\n", stat_cache_evictions);
+	fprintf(fp, "  \"cache_verify_mismatches\": %d,\n", stat_cache_verify_mismatches);
+	fprintf(fp, "  \"safety_kernel\": \"%s\",\n", safetyKernelName);
+	fprintf(fp, "  \"kernel_verify_mismatches\": %d,\n", stat_kernel_verify_mismatches);
+	fprintf(fp, "  \"replies_sent\": %d,\n", stat_replies_sent);
+	fprintf(fp, "  \"replies_deferred\": %d,\n", stat_replies_deferred);
+	fprintf(fp, "  \"outbox_growths\": %d,\n", stat_outbox_growths);
+	fprintf(fp, "  \"replies_purged\": %d,\n", stat_replies_purged);
+	fprintf(fp, "  \"max_outbox_depth\": %d,\n", stat_max_outbox_depth);
+	fprintf(fp, "  \"max_queue_depth\": %d,\n", stat_max_queue_depth);
+	fprintf(fp, "  \"lease_size\": %d,\n", leaseSize);
+	fprintf(fp, "  \"lease_instances_issued\": %d,\n", stat_lease_instances_issued);
+	fprintf(fp, "  \"lease_instances_revoked\": %d,\n", stat_lease_instances_revoked);
+	fprintf(fp, "  \"lease_fast_grants\": %u,\n", sharedState ? atomic_load(&sharedState->leases.fastGrants) : 0);
+	fprintf(fp, "  \"lease_reconciles\": %d,\n", stat_lease_reconciles);
+	char cpuList[512];
+	formatCpuList(cpuList, sizeof(cpuList));
+	fprintf(fp, "  \"oss_cpu\": %d,\n", ossCpu);
+	fprintf(fp, "  \"worker_placement\": \"%s\",\n", placementNames[workerPlacement]);
+	fprintf(fp, "  \"worker_cpus\": \"%s\",\n", cpuList);
+	fprintf(fp, "  \"checkpoint_deferrals\": %d,\n", stat_checkpoint_deferrals);
+	fprintf(fp, "  \"control_commands\": %d,\n", stat_control_commands);
+	fprintf(fp, "  \"pacing\": \"%s\",\n", pacingNames[pacingMode]);
+	fprintf(fp, "  \"pacing_wakeups\": %d,\n", stat_pacing_wakeups);
+	fprintf(fp, "  \"fast_forward_ms\": %lld,\n", stat_fast_forward_ms);
+	fprintf(fp, "  \"event_polls\": %d,\n", stat_event_polls);
+	fprintf(fp, "  \"event_polls_skipped\": %d,\n", stat_event_polls_skipped);
+	fprintf(fp, "  \"workers_respawned\": %d,\n", stat_workers_respawned);
+	fprintf(fp, "  \"federation_partitions\": %d,\n", federatedPartitions);
+	fprintf(fp, "  \"federation_kills\": %d,\n", stat_federation_kills);
+	fprintf(fp, "  \"federation_rounds\": %d,\n", stat_federation_rounds);
+	fprintf(fp, "  \"federation_incomplete_rounds\": %d,\n", stat_federation_incomplete);
+	fprintf(fp, "  \"oracle\": %s,\n", oracleEnabled ? "true" : "false");
+	fprintf(fp, "  \"oracle_events\": %d,\n", stat_oracle_events);
+	fprintf(fp, "  \"oracle_decisions\": %d,\n", stat_oracle_decisions);
+	fprintf(fp, "  \"oracle_divergences\": %d,\n", stat_oracle_divergences);
+	for (int p = 0; p < federatedPartitions; p++) {
+		PartitionStats *st = &sharedState->federation.stats[p];
+		fprintf(fp, "  \"p%d_cpu\": %d,\n", p, st->cpu);
+		fprintf(fp, "  \"p%d_grants\": %d,\n", p, st->grants);
+		fprintf(fp, "  \"p%d_waits\": %d,\n", p, st->waits);
+		fprintf(fp, "  \"p%d_blocked_reported\": %d,\n", p, st->blockedReported);
+	}
+	fprintf(fp, "  \"deadlock_recovery\": \"%s\",\n", recoveryNames[recoveryMode]);
+	fprintf(fp, "  \"preemptions\": %d,\n", stat_preemptions);
+	fprintf(fp, "  \"deadlock_terminations\": %d,\n", stat_deadlock_terminations);
+	fprintf(fp, "  \"normal_terminations\": %d,\n", stat_normal_terminations);
+	fprintf(fp, "  \"exits_deadlock_killed\": %d,\n", stat_exits_deadlock_killed);
+	fprintf(fp, "  \"exits_crashed\": %d,\n", stat_exits_crashed);
+	fprintf(fp, "  \"exits_unannounced\": %d,\n", stat_exits_unannounced);
+	fprintf(fp, "  \"exits_at_shutdown\": %d,\n", stat_exits_at_shutdown);
+	LifeSummary life;
+	summarizeLifecycles(&life);
+	fprintf(fp, "  \"life_workers\": %d,\n", lifeCount);
+	fprintf(fp, "  \"life_turnaround_p50_ms\": %.0f,\n", life.turnaround[0]);
+	fprintf(fp, "  \"life_turnaround_p90_ms\": %.0f,\n", life.turnaround[1]);
+	fprintf(fp, "  \"life_turnaround_p99_ms\": %.0f,\n", life.turnaround[2]);
+	fprintf(fp, "  \"life_blocked_fraction_p50\": %.4f,\n", life.blockedFraction[0]);
+	fprintf(fp, "  \"life_blocked_fraction_p90\": %.4f,\n", life.blockedFraction[1]);
+	fprintf(fp, "  \"life_blocked_fraction_p99\": %.4f,\n", life.blockedFraction[2]);
+	fprintf(fp, "  \"life_blocked_pct\": %.2f,\n", life.turnaroundMs ? 100.0 * life.blockedMs / life.turnaroundMs : 0.0);
+	fprintf(fp, "  \"life_holding_pct\": %.2f,\n", life.turnaroundMs ? 100.0 * life.serviceMs / life.turnaroundMs : 0.0);
+	fprintf(fp, "  \"life_work_lost_ms\": %lld,\n", life.lostMs);
+	fprintf(fp, "  \"life_work_lost_instance_ms\": %lld,\n", life.lostInstanceMs);
+	long long simNow = simTimeNs();
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		ResourceProfile *prof = &resourceProfile[j];
+		fprintf(fp, "  \"r%d_requests\": %d,\n", j, prof->requests);
+		fprintf(fp, "  \"r%d_grants\": %d,\n", j, prof->grants);
+		fprintf(fp, "  \"r%d_waits_unavailable\": %d,\n", j, prof->waitsUnavailable);
+		fprintf(fp, "  \"r%d_waits_unsafe\": %d,\n", j, prof->waitsUnsafe);
+		fprintf(fp, "  \"r%d_denied_claim\": %d,\n", j, prof->deniedClaim);
+		fprintf(fp, "  \"r%d_hold_mean_ms\": %.4f,\n", j, prof->holds ? prof->holdTotalNs / 1e6 / prof->holds : 0.0);
+		fprintf(fp, "  \"r%d_hold_p90_ms\": %.1f,\n", j, holdPercentileMs(prof, 0.9));
+		fprintf(fp, "  \"r%d_utilization\": %.4f,\n", j, profileUtilization(prof, simNow));
+		fprintf(fp, "  \"r%d_mean_queue_depth\": %.4f,\n", j, profileMeanQueueDepth(prof, simNow));
+	}
+	fprintf(fp, "  \"deadlock_detection_runs\": %d,\n", stat_deadlock_detection_runs);
+	fprintf(fp, "  \"deadlock_processes_terminated\": %d\n", stat_deadlock_processes_terminated);
+	fprintf(fp, "}\n");
+
+	fclose(fp);
+	return 0;
+}
+
+
+
+//Batched message handling: everything pending is drained each loop and decided together
+#define MAX_MESSAGE_BATCH 64
+#define POLL_BUSY_INTERVAL 16 //while batches keep coming, poll the other event sources this often
+
+typedef struct {
+	pid_t pid;
+	int processIndex;
+	int resourceId; //single-instance request, -1 for a vector request
+	int counts[NUM_RESOURCES];
+} BatchRequest;
+
+typedef struct {
+	pid_t pid;
+	int status;
+} PendingReply;
+
+struct oss_message messageBatch[MAX_MESSAGE_BATCH];
+PendingReply replyBatch[MAX_MESSAGE_BATCH];
+int replyBatchCount = 0;
+
+//Replies are held until the whole batch is decided, then sent together
+void queueReply(pid_t pid, int status) {
+	if (replyBatchCount == MAX_MESSAGE_BATCH) {
+		send_message_to_worker(pid, status);
+		return;
+	}
+	replyBatch[replyBatchCount].pid = pid;
+	replyBatch[replyBatchCount].status = status;
+	replyBatchCount++;
+}
+
+void flushReplies() {
+	for (int i = 0; i < replyBatchCount; i++) {
+		send_message_to_worker(replyBatch[i].pid, replyBatch[i].status);
+	}
+	replyBatchCount = 0;
+}
+
+//Pull every message addressed to oss off the queue without blocking
+int drainMessages(struct oss_message *batch, int maxBatch) {
+	int count = 0;
+	while (count < maxBatch) {
+		//Only take messages addressed to oss, never the replies waiting for workers
+		if (msgrcv(msqid, &batch[count], sizeof(struct oss_message) - sizeof(long), OSS_MTYPE, IPC_NOWAIT) == -1) {
+			if (errno != ENOMSG) {  // Only show error if it's not "no message"
+				perror("msgrcv");
+			}
+			break;
+		}
+		count++;
+	}
+	return count;
+}
+
+//One safety check for a whole group of requests granted together
+bool isSafeBatch(const BatchRequest *reqs, int n) {
+	int work[NUM_RESOURCES];
+	int temp_need[18][NUM_RESOURCES];
+	int grants[18][NUM_RESOURCES]; //only rows of processes in the group are used
+	const int *pendingGrant[18] = {NULL};
+
+	memcpy(work, available, sizeof(work));
+	memcpy(temp_need, need, sizeof(temp_need));
+	for (int k = 0; k < n; k++) {
+		int i = reqs[k].processIndex;
+		if (!pendingGrant[i]) {
+			memset(grants[i], 0, sizeof(grants[i]));
+			pendingGrant[i] = grants[i];
+		}
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			work[j] -= reqs[k].counts[j];
+			grants[i][j] += reqs[k].counts[j];
+			temp_need[i][j] -= reqs[k].counts[j];
+			if (work[j] < 0 || temp_need[i][j] < 0) {
+				return false;
+			}
+		}
+	}
+	return safeSequenceExists(work, temp_need, pendingGrant);
+}
+
+void commitBatchRequest(const BatchRequest *req) {
+	countLegacyDenial(req->processIndex, req->counts);
+	applyGrant(req->processIndex, req->counts);
+	countGrant(false);
+	oss_log_verbose("OSS: Granted request of process %d\n", req->pid);
+	queueReply(req->pid, STATUS_GRANTED);
+}
+
+//shortBy[j] > 0 marks the resources that ran out (WAIT_UNAVAILABLE); NULL blames every resource asked for
+void waitBatchRequest(const BatchRequest *req, int reason, const int *shortBy) {
+	oss_log_verbose("OSS: Request of process %d must wait (%s)\n", req->pid,
+			reason == WAIT_UNAVAILABLE ? "unavailable" : "unsafe");
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (req->counts[j] <= 0 || (shortBy && shortBy[j] <= 0)) continue;
+		if (reason == WAIT_UNAVAILABLE) resourceProfile[j].waitsUnavailable++;
+		else resourceProfile[j].waitsUnsafe++;
+	}
+	//The worker stays blocked until processWaitQueue grants it; only deny if we can't queue it
+	if (!addVectorToWaitQueue(req->pid, req->counts, req->resourceId)) {
+		lifeDenied(req->processIndex);
+		queueReply(req->pid, STATUS_DENIED);
+	}
+}
+
+//Grant a group with one combined safety check; if that fails, halve it and try each half
+void decideRequestGroup(BatchRequest *reqs, int n) {
+	if (n == 0) return;
+
+	if (!needsSafetyCheck()) {
+		for (int k = 0; k < n; k++) {
+			stat_optimistic_grants++;
+			applyGrant(reqs[k].processIndex, reqs[k].counts);
+			countGrant(false);
+			queueReply(reqs[k].pid, STATUS_GRANTED);
+		}
+		return;
+	}
+
+	stat_safety_checks++;
+	bool safe = (n == 1) ? cachedIsSafe(reqs[0].processIndex, reqs[0].counts) : isSafeBatch(reqs, n);
+	if (oracleEnabled) {
+		int slots[MAX_MESSAGE_BATCH];
+		int counts[MAX_MESSAGE_BATCH * NUM_RESOURCES];
+		for (int k = 0; k < n; k++) {
+			slots[k] = reqs[k].processIndex;
+			memcpy(&counts[k * NUM_RESOURCES], reqs[k].counts, sizeof(reqs[k].counts));
+		}
+		oracleCheckDecision(n, slots, counts, safe);
+	}
+	if (safe) {
+		for (int k = 0; k < n; k++) {
+			commitBatchRequest(&reqs[k]);
+		}
+		return;
+	}
+	if (n == 1) {
+		waitBatchRequest(&reqs[0], WAIT_UNSAFE, NULL);
+		return;
+	}
+	stat_batch_splits++;
+	decideRequestGroup(reqs, n / 2);
+	decideRequestGroup(reqs + n / 2, n - n / 2);
+}
+
+//Decide all new requests of this loop iteration
+void decideRequestBatch(BatchRequest *reqs, int n) {
+	if (n == 0) return;
+	struct timespec decide_start, decide_end;
+	long long legacyBefore = stat_legacy_wall_ns;
+	clock_gettime(CLOCK_MONOTONIC, &decide_start);
+
+	stat_batches++;
+	stat_batched_requests += n;
+	if (n > stat_max_batch) stat_max_batch = n;
+
+	//Requests that don't fit in what is left have to wait; the rest are decided together
+	BatchRequest candidates[MAX_MESSAGE_BATCH];
+	int candidateCount = 0;
+	int remaining[NUM_RESOURCES];
+	memcpy(remaining, available, sizeof(remaining));
+	for (int k = 0; k < n; k++) {
+		bool fits = true;
+		int shortBy[NUM_RESOURCES];
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			shortBy[j] = reqs[k].counts[j] - remaining[j];
+			if (shortBy[j] > 0) fits = false;
+		}
+		if (!fits) {
+			waitBatchRequest(&reqs[k], WAIT_UNAVAILABLE, shortBy);
+			continue;
+		}
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			remaining[j] -= reqs[k].counts[j];
+		}
+		candidates[candidateCount++] = reqs[k];
+	}
+	decideRequestGroup(candidates, candidateCount);
+
+	clock_gettime(CLOCK_MONOTONIC, &decide_end);
+	stat_decision_wall_ns += (decide_end.tv_sec - decide_start.tv_sec) * 1000000000LL +
+		(decide_end.tv_nsec - decide_start.tv_nsec) - (stat_legacy_wall_ns - legacyBefore);
+	stat_decisions += n;
+}
+
+//Handle one drained batch: capacity-returning messages first, then the wait queue, then new requests
+void processMessageBatch(struct oss_message *batch, int count) {
+	BatchRequest requests[MAX_MESSAGE_BATCH];
+	int requestCount = 0;
+
+	for (int m = 0; m < count; m++) {
+		struct oss_message *msg = &batch[m];
+
+		// Validate message before processing
+		if (msg->command != REQUEST_RESOURCE && 
+			msg->command != RELEASE_RESOURCE && 
+			msg->command != TERMINATE &&
+			msg->command != CLAIM_RESOURCES &&
+			msg->command != REQUEST_VECTOR &&
+			msg->command != RELEASE_VECTOR &&
+			msg->command != RELEASE_ALL_TERMINATE) {
+			// Instead of warning, just skip invalid messages silently
+			continue;
+		}
+
+		if (msg->resourceId < 0 || msg->resourceId >= NUM_RESOURCES) {
+			// Instead of warning, just skip invalid resource IDs silently
+			continue;
+		}
+
+		switch (msg->command) {
+			case REQUEST_RESOURCE:
+			case REQUEST_VECTOR: {
+				int processIndex = findProcessIndex(msg->pid);
+				if (processIndex == -1) {
+					fprintf(stderr, "OSS Warning: Request from unknown process %d\n", msg->pid);
+					break;
+				}
+
+				BatchRequest *req = &requests[requestCount];
+				req->pid = msg->pid;
+				req->processIndex = processIndex;
+				memset(req->counts, 0, sizeof(req->counts));
+				if (msg->command == REQUEST_RESOURCE) {
+					req->resourceId = msg->resourceId;
+					req->counts[msg->resourceId] = 1;
+				} else {
+					req->resourceId = -1;
+					memcpy(req->counts, msg->counts, sizeof(req->counts));
+				}
+
+				//A leased instance counts as allocated, so need shrinks before the worker has claimed it. A request
+				//beyond that need can still be within the claim; take the unclaimed lease back before judging it.
+				if (leasesOutstanding) {
+					int overNeed[NUM_RESOURCES] = {0};
+					bool over = false;
+					for (int j = 0; j < NUM_RESOURCES; j++) {
+						if (req->counts[j] > need[processIndex][j]) overNeed[j] = over = true;
+					}
+					int returned = over ? revokeLeases(processIndex, overNeed) : 0;
+					if (returned > 0) {
+						stat_lease_instances_revoked += returned;
+						waitQueueDirty = true;
+					}
+				}
+
+				// Check if request is valid: non-empty and within the claim
+				int total = 0;
+				bool valid = true;
+				for (int j = 0; j < NUM_RESOURCES; j++) {
+					if (req->counts[j] < 0 || req->counts[j] > need[processIndex][j]) valid = false;
+					total += req->counts[j];
+				}
+				profileRequest(req->counts);
+				if (!valid || total == 0) {
+					for (int j = 0; j < NUM_RESOURCES; j++) {
+						if (req->counts[j] > 0) resourceProfile[j].deniedClaim++;
+					}
+					fprintf(stderr, "OSS Warning: Process %d requesting beyond its claim\n", msg->pid);
+					lifeDenied(processIndex);
+					queueReply(msg->pid, STATUS_DENIED);
+					break;
+				}
+				requestCount++;
+				break;
+			}
+			case RELEASE_RESOURCE:
+			case RELEASE_VECTOR: {
+				int processIndex = findProcessIndex(msg->pid);
+				if (processIndex != -1) {
+					int counts[NUM_RESOURCES] = {0};
+					if (msg->command == RELEASE_RESOURCE) {
+						counts[msg->resourceId] = 1;
+					} else {
+						memcpy(counts, msg->counts, sizeof(counts));
+					}
+					int released = releaseInstances(processIndex, counts);
+					oss_log_verbose("OSS: Process %d released %d instances\n", msg->pid, released);
+					queueReply(msg->pid, STATUS_GRANTED); // Acknowledge so the worker doesn't stay blocked
+				}
+				break;
+			}
+			case TERMINATE: {
+				int processIndex = findProcessIndex(msg->pid);
+				if (processIndex != -1) {
+					endLifecycle(processIndex, EXIT_NORMAL);
+					releaseAllAndRemove(processIndex);
+					noteDeparture(msg->pid, EXIT_NORMAL); //counted when it is reaped
+				}
+				queueReply(msg->pid, STATUS_GRANTED); // Send confirmation so user_proc can exit
+				break;
+			}
+			case RELEASE_ALL_TERMINATE: {
+				int processIndex = findProcessIndex(msg->pid);
+				if (processIndex != -1) {
+					endLifecycle(processIndex, EXIT_NORMAL);
+					releaseAllAndRemove(processIndex);
+					noteDeparture(msg->pid, EXIT_NORMAL); //counted when it is reaped
+					oss_log_verbose("OSS: Process %d released everything and is exiting\n", msg->pid);
+				}
+				break;
+			}
+			case CLAIM_RESOURCES:
+				queueReply(msg->pid, handleClaim(msg->pid, msg->counts));
+				break;
+			default: 
+				oss_log("OSS: Unknown message command %d from process %d\n",
+					msg->command, msg->pid);
+		}
+	}
+
+	//Requests already waiting get first pick of anything released in this batch
+	if (waitQueueDirty) {
+		processWaitQueue();
+	}
+	decideRequestBatch(requests, requestCount);
+	flushReplies();
+}
+
+// Add launch interval to global variables
+long long last_launch_ns = 0; //sim time of the last launch or rejected launch
+int totalProcesses = 0;
+long long admission_delayed_since_ns = -1; //sim time the pending launch was first delayed, -1 if none
+
+#define ADMIT_LAUNCH 0
+#define ADMIT_DELAY 1
+#define ADMIT_REJECT 2
+
+//Banker's headroom: total available instances minus the outstanding max claims (need) of live processes
+int bankersHeadroom() {
+	int headroom = 0;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		headroom += available[j];
+	}
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		if (processTable[i].pid == 0) continue;
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			//Under -F only our own resources have instances here; the others' need is theirs to cover
+			if (federatedPartitions > 0 && sharedState->federation.owner[j] != partitionId) continue;
+			headroom -= need[i][j];
+		}
+	}
+	return headroom;
+}
+
+//Decide whether a launch that is due now should go ahead
+int admissionDecision(long long now_ns) {
+	int headroom = bankersHeadroom();
+	if (headroom >= admissionMinHeadroom && waitQueueSize < admissionMaxWait) {
+		admission_delayed_since_ns = -1;
+		return ADMIT_LAUNCH;
+	}
+
+	if (admission_delayed_since_ns < 0) {
+		//Counted once per launch held back, not on every tick it stays held
+		admission_delayed_since_ns = now_ns;
+		stat_admission_delays++;
+		oss_log_verbose("OSS: Delaying launch (headroom %d, %d blocked requests)\n", headroom, waitQueueSize);
+	}
+	if (now_ns - admission_delayed_since_ns >= (long long)admissionRejectMs * 1000000) {
+		admission_delayed_since_ns = -1;
+		oss_log_verbose("OSS: Rejecting launch after %d ms under pressure\n", admissionRejectMs);
+		return ADMIT_REJECT;
+	}
+	return ADMIT_DELAY;
+}
+
+//Lease-based fast path (-L). While nothing is blocked, oss pre-grants each live worker up to leaseSize
+//instances of every resource it still has claim for, after a banker's check as if they were requested.
+//Leased instances count as allocated to the worker; it claims them with one CAS and no message.
+//The moment any request has to wait, every unclaimed lease is revoked and the instances come back.
+#define LEASE_RECONCILE_MS 10
+
+//Take back what process i hasn't claimed yet of the resources marked in only (NULL: all of them).
+//Returns instances returned.
+int revokeLeases(int i, const int *only) {
+	int returned = 0;
+	int returnedCounts[NUM_RESOURCES] = {0};
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (only != NULL && only[j] == 0) continue;
+		uint64_t word = atomic_exchange(&sharedState->leases.lease[i][j], 0);
+		int unclaimed = LEASE_PID(word) == processTable[i].pid ? LEASE_COUNT(word) : 0;
+		if (unclaimed <= 0) {
+			if (leaseUnclaimed[i][j] > 0) setLeasedAllocation(i, j, allocation[i][j], 0); //all claimed
+			continue;
+		}
+		if (unclaimed > allocation[i][j]) unclaimed = allocation[i][j];
+		setAvailable(j, available[j] + unclaimed);
+		setLeasedAllocation(i, j, allocation[i][j] - unclaimed, 0);
+		returnedCounts[j] = unclaimed;
+		returned += unclaimed;
+	}
+	if (oracleEnabled) oracleRelease(i, returnedCounts);
+	return returned;
+}
+
+void revokeAllLeases() {
+	if (!leasesOutstanding) return;
+	int returned = 0;
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		if (processTable[i].pid != 0) returned += revokeLeases(i, NULL);
+	}
+	leasesOutstanding = false;
+	if (returned > 0) {
+		stat_lease_instances_revoked += returned;
+		waitQueueDirty = true;
+		oss_log_verbose("OSS: Revoked %d leased instances\n", returned);
+	}
+}
+
+//Top up leases while nothing is blocked, and publish availability (every LEASE_RECONCILE_MS)
+void reconcileLeases() {
+	stat_lease_reconciles++;
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		for (int j = 0; j < NUM_RESOURCES && leaseUnclaimedTotal[i] > 0; j++) {
+			syncLeaseClaims(i, j);
+		}
+	}
+	if (waitQueueSize == 0) {
+		for (int i = 0; i < MAX_PROCESSES; i++) {
+			pid_t pid = processTable[i].pid;
+			if (pid == 0) continue;
+			int topUp[NUM_RESOURCES] = {0};
+			int unclaimed[NUM_RESOURCES];
+			int total = 0;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				uint64_t word = atomic_load(&sharedState->leases.lease[i][j]);
+				unclaimed[j] = LEASE_PID(word) == pid ? LEASE_COUNT(word) : 0;
+				int want = leaseSize - unclaimed[j];
+				if (want > need[i][j]) want = need[i][j];
+				if (want > available[j]) want = available[j];
+				if (want > 0) {
+					topUp[j] = want;
+					total += want;
+				}
+			}
+			bool safe = total > 0 && cachedIsSafe(i, topUp);
+			if (total > 0 && oracleEnabled) oracleCheckDecision(1, &i, topUp, safe);
+			if (!safe) continue;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				if (topUp[j] == 0) continue;
+				setAvailable(j, available[j] - topUp[j]);
+				//The worker may have claimed since we looked; add on top of whatever is left now
+				uint64_t word = atomic_load(&sharedState->leases.lease[i][j]);
+				uint64_t next;
+				int left;
+				do {
+					left = LEASE_PID(word) == pid ? LEASE_COUNT(word) : 0;
+					next = LEASE_WORD(pid, left + topUp[j]);
+				} while (!atomic_compare_exchange_weak(&sharedState->leases.lease[i][j], &word, next));
+				setLeasedAllocation(i, j, allocation[i][j] + topUp[j], left + topUp[j]);
+			}
+			if (oracleEnabled) oracleGrant(i, topUp);
+			stat_lease_instances_issued += total;
+			leasesOutstanding = true;
+		}
+	}
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		atomic_store(&sharedState->leases.published[j], available[j]);
+	}
+}
+
+void occupySlot(int slot, pid_t pid);
+
+//Reference oracle (-D) and fuzzer (-Z). The oracle keeps its own copy of the allocator state and
+//updates it from the same events as the engine (grants, releases, claims, slots coming and going),
+//using nothing but the textbook rules. After every event it checks the engine against that copy:
+//the matrices and available, allocations plus available adding up to the total, and every view
+//derived from them (resource table, sparse view, packed lanes, state hash). Every banker's verdict
+//and every detection result is recomputed on the copy with the plain algorithms. The first
+//divergence is reported with a replay: the state just before it, written as fuzzer events, then
+//the event itself. ./oss -Z file re-runs a replay.
+#define ORACLE_HISTORY 16
+#define FUZZ_PID_BASE 0x40000000 //above any real pid, so kill() on a fuzzed process finds nobody
+#define FUZZ_RUN_EVENTS 64 //events generated per fuzz run
+#define FUZZ_MAX_EVENTS 4096 //longest replay file
+
+#define FUZZ_STRATEGY 0
+#define FUZZ_RECOVERY 1
+#define FUZZ_POLICY 2
+#define FUZZ_SPAWN 3 //a worker starts in slot
+#define FUZZ_FREE 4 //slot freed without reclaiming anything
+#define FUZZ_MAX 5 //set one max claim entry
+#define FUZZ_GIVE 6 //grant counts without a decision
+#define FUZZ_RELEASE 7
+#define FUZZ_RECLAIM 8 //take back everything slot holds
+#define FUZZ_BLOCK 9 //queue a request as if it had to wait
+#define FUZZ_MSG 10 //worker message, handled at the next flush
+#define FUZZ_FLUSH 11 //hand the pending messages to processMessageBatch
+#define FUZZ_CHECK 12 //banker's verdict only
+#define FUZZ_DETECT 13 //deadlock detection and recovery
+#define FUZZ_WAKE 14 //a wait queue pass
+#define FUZZ_KINDS 15
+const char *fuzzEventNames[] = {"strategy", "recovery", "policy", "spawn", "free", "max", "give", "release",
+	"reclaim", "block", "msg", "flush", "check", "detect", "wake"};
+//Indexed by oss_message command
+const char *fuzzCommandNames[] = {"", "request1", "release1", "terminate", "claim", "request", "release", "exit"};
+
+typedef struct {
+	int kind;
+	int slot; //the setting for strategy, recovery and policy
+	int command; //msg: oss_message command; max: the resource
+	int counts[NUM_RESOURCES]; //max: the value in counts[0]
+} FuzzEvent;
+
+typedef struct {
+	pid_t pid[18];
+	int allocation[18][NUM_RESOURCES];
+	int max[18][NUM_RESOURCES];
+	int available[NUM_RESOURCES];
+} OracleState;
+
+OracleState oracle;
+OracleState oracleBefore; //copy from before the event being checked, for the replay
+FuzzEvent oracleHistory[ORACLE_HISTORY]; //latest events, oldest first from oracleHistoryNext
+int oracleHistoryNext = 0;
+bool oracleMode = false; //-D
+char *fuzzSpec = NULL; //-Z
+bool fuzzing = false; //the fuzzer reports divergences itself
+char oracleDivergence[256] = ""; //the first one
+
+void formatFuzzEvent(char *buf, size_t size, const FuzzEvent *ev) {
+	int len = snprintf(buf, size, "%s", fuzzEventNames[ev->kind]);
+	switch (ev->kind) {
+		case FUZZ_STRATEGY:
+			snprintf(buf + len, size - len, " %s", strategyNames[ev->slot]);
+			return;
+		case FUZZ_RECOVERY:
+			snprintf(buf + len, size - len, " %s", recoveryNames[ev->slot]);
+			return;
+		case FUZZ_POLICY:
+			snprintf(buf + len, size - len, " %s", policyNames[ev->slot]);
+			return;
+		case FUZZ_SPAWN:
+		case FUZZ_FREE:
+		case FUZZ_RECLAIM:
+			snprintf(buf + len, size - len, " %d", ev->slot);
+			return;
+		case FUZZ_MAX:
+			snprintf(buf + len, size - len, " %d %d %d", ev->slot, ev->command, ev->counts[0]);
+			return;
+		case FUZZ_FLUSH:
+		case FUZZ_DETECT:
+		case FUZZ_WAKE:
+			return;
+	}
+	len += snprintf(buf + len, size - len, " %d", ev->slot);
+	if (ev->kind == FUZZ_MSG) len += snprintf(buf + len, size - len, " %s", fuzzCommandNames[ev->command]);
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		len += snprintf(buf + len, size - len, " %d", ev->counts[j]);
+	}
+}
+
+void writeFuzzEvents(FILE *fp, const FuzzEvent *events, int n) {
+	char line[128];
+	for (int k = 0; k < n; k++) {
+		formatFuzzEvent(line, sizeof(line), &events[k]);
+		fprintf(fp, "%s\n", line);
+	}
+}
+
+int lookupName(const char *name, const char **names, int count) {
+	for (int k = 0; k < count; k++) {
+		if (strcmp(name, names[k]) == 0) return k;
+	}
+	return -1;
+}
+
+//Read a replay written by writeFuzzEvents. Returns the number of events, -1 on a bad line.
+int readFuzzEvents(const char *path, FuzzEvent *events, int maxEvents) {
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		perror("fopen replay");
+		return -1;
+	}
+	char line[256];
+	int n = 0, lineNo = 0;
+	while (fgets(line, sizeof(line), fp) && n < maxEvents) {
+		lineNo++;
+		char word[32], name[32];
+		int offset;
+		if (line[0] == '#' || sscanf(line, "%31s%n", word, &offset) != 1) continue;
+		FuzzEvent *ev = &events[n];
+		memset(ev, 0, sizeof(*ev));
+		ev->kind = lookupName(word, fuzzEventNames, FUZZ_KINDS);
+		const char *rest = line + offset;
+		bool ok = ev->kind != -1;
+		if (ok && ev->kind <= FUZZ_POLICY) {
+			ok = sscanf(rest, "%31s", name) == 1;
+			if (ok) {
+				ev->slot = ev->kind == FUZZ_STRATEGY ? lookupName(name, strategyNames, 3) :
+					ev->kind == FUZZ_RECOVERY ? lookupName(name, recoveryNames, 2) : lookupName(name, policyNames, 4);
+				ok = ev->slot != -1;
+			}
+		} else if (ok && ev->kind == FUZZ_MAX) {
+			ok = sscanf(rest, "%d %d %d", &ev->slot, &ev->command, &ev->counts[0]) == 3 &&
+				ev->command >= 0 && ev->command < NUM_RESOURCES;
+		} else if (ok && (ev->kind == FUZZ_SPAWN || ev->kind == FUZZ_FREE || ev->kind == FUZZ_RECLAIM)) {
+			ok = sscanf(rest, "%d", &ev->slot) == 1;
+		} else if (ok && ev->kind != FUZZ_FLUSH && ev->kind != FUZZ_DETECT && ev->kind != FUZZ_WAKE) {
+			int used;
+			ok = sscanf(rest, "%d%n", &ev->slot, &used) == 1;
+			rest += ok ? used : 0;
+			if (ok && ev->kind == FUZZ_MSG) {
+				ok = sscanf(rest, "%31s%n", name, &used) == 1 && (ev->command = lookupName(name, fuzzCommandNames, 8)) > 0;
+				rest += ok ? used : 0;
+			}
+			for (int j = 0; ok && j < NUM_RESOURCES; j++) {
+				ok = sscanf(rest, "%d%n", &ev->counts[j], &used) == 1;
+				rest += used;
+			}
+		}
+		if (!ok || ev->slot < 0 || ev->slot >= 18) {
+			fprintf(stderr, "%s:%d: can't read '%s'\n", path, lineNo, word);
+			fclose(fp);
+			return -1;
+		}
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+//Take the engine's current state as the truth (at startup, after a restore, after a divergence)
+void oracleResync() {
+	for (int i = 0; i < 18; i++) {
+		oracle.pid[i] = processTable[i].pid;
+		memcpy(oracle.allocation[i], allocation[i], sizeof(oracle.allocation[i]));
+		memcpy(oracle.max[i], max[i], sizeof(oracle.max[i]));
+	}
+	memcpy(oracle.available, available, sizeof(oracle.available));
+}
+
+int oracleSlotOf(pid_t pid) {
+	for (int i = 0; i < 18; i++) {
+		if (pid != 0 && oracle.pid[i] == pid) return i;
+	}
+	return -1;
+}
+
+//The replay for a divergence: oracleBefore rebuilt from events, then the events that diverged
+void writeOracleReplay(const char *path, const FuzzEvent *failing, int failingCount) {
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		perror("fopen oracle replay");
+		return;
+	}
+	FuzzEvent events[18 * (NUM_RESOURCES + 2) + MAX_WAIT_QUEUE + 3];
+	int n = 0;
+	events[n++] = (FuzzEvent){FUZZ_STRATEGY, deadlockStrategy, 0, {0}};
+	events[n++] = (FuzzEvent){FUZZ_RECOVERY, recoveryMode, 0, {0}};
+	events[n++] = (FuzzEvent){FUZZ_POLICY, waitPolicy, 0, {0}};
+	for (int i = 0; i < 18; i++) {
+		if (oracleBefore.pid[i] == 0) continue;
+		events[n++] = (FuzzEvent){FUZZ_SPAWN, i, 0, {0}};
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			if (oracleBefore.max[i][j] != DEFAULT_MAX_CLAIM) events[n++] = (FuzzEvent){FUZZ_MAX, i, j, {oracleBefore.max[i][j]}};
+		}
+		events[n] = (FuzzEvent){FUZZ_GIVE, i, 0, {0}};
+		memcpy(events[n].counts, oracleBefore.allocation[i], sizeof(events[n].counts));
+		n++;
+	}
+	for (int w = 0; w < waitQueueSize; w++) {
+		int i = oracleSlotOf(waitQueue[w].pid);
+		if (i == -1) continue;
+		events[n] = (FuzzEvent){FUZZ_BLOCK, i, 0, {0}};
+		memcpy(events[n].counts, waitQueue[w].counts, sizeof(events[n].counts));
+		n++;
+	}
+	fprintf(fp, "# oss reference-oracle replay, run it with ./oss -Z %s\n# %s\n", path, oracleDivergence);
+	writeFuzzEvents(fp, events, n);
+	writeFuzzEvents(fp, failing, failingCount);
+	fprintf(fp, "# latest events before it:\n");
+	for (int k = 0; k < ORACLE_HISTORY; k++) {
+		const FuzzEvent *ev = &oracleHistory[(oracleHistoryNext + k) % ORACLE_HISTORY];
+		char line[128];
+		if (ev->kind == 0 && ev->slot == 0 && ev->command == 0) continue; //never filled
+		formatFuzzEvent(line, sizeof(line), ev);
+		fprintf(fp, "#   %s\n", line);
+	}
+	fclose(fp);
+}
+
+void oracleDiverged(const FuzzEvent *failing, int failingCount, const char *fmt, ...) {
+	if (stat_oracle_divergences++ > 0) return; //only the first is reported in full
+	char line[128];
+	formatFuzzEvent(line, sizeof(line), &failing[0]);
+	int len = snprintf(oracleDivergence, sizeof(oracleDivergence), "allocator event %d (%s): ", stat_oracle_events, line);
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(oracleDivergence + len, sizeof(oracleDivergence) - len, fmt, args);
+	va_end(args);
+	if (fuzzing) return;
+
+	char path[64];
+	snprintf(path, sizeof(path), "oracle-%u.replay", runId);
+	writeOracleReplay(path, failing, failingCount);
+	oss_log("OSS: Oracle divergence at %s, replay written to %s\n", oracleDivergence, path);
+}
+
+//Compare the engine with the oracle after an event; on a mismatch report it and adopt the engine's state
+void oracleCheckState(const FuzzEvent *ev) {
+	oracleHistory[oracleHistoryNext] = *ev;
+	oracleHistoryNext = (oracleHistoryNext + 1) % ORACLE_HISTORY;
+	stat_oracle_events++;
+
+	char what[160] = "";
+	for (int j = 0; j < NUM_RESOURCES && !what[0]; j++) {
+		int total = available[j];
+		for (int i = 0; i < 18; i++) total += allocation[i][j];
+		if (total != NUM_INSTANCES) {
+			snprintf(what, sizeof(what), "R%d: allocations plus available are %d, not %d", j, total, NUM_INSTANCES);
+		} else if (available[j] != oracle.available[j]) {
+			snprintf(what, sizeof(what), "R%d: %d available, reference has %d", j, available[j], oracle.available[j]);
+		} else if (resourceTable[j].availableInstances != available[j]) {
+			snprintf(what, sizeof(what), "R%d: resource table has %d available, not %d", j,
+				resourceTable[j].availableInstances, available[j]);
+		}
+	}
+	for (int i = 0; i < 18 && !what[0]; i++) {
+		int held = 0, heldKinds = 0;
+		if (processTable[i].pid != oracle.pid[i]) {
+			snprintf(what, sizeof(what), "P%d: pid %d, reference has %d", i, processTable[i].pid, oracle.pid[i]);
+		} else if ((processTable[i].pid != 0) != (liveMask >> i & 1)) {
+			snprintf(what, sizeof(what), "P%d: live mask is stale", i);
+		}
+		for (int j = 0; j < NUM_RESOURCES && !what[0]; j++) {
+			held += allocation[i][j];
+			heldKinds += allocation[i][j] > 0;
+			if (allocation[i][j] != oracle.allocation[i][j] || max[i][j] != oracle.max[i][j]) {
+				snprintf(what, sizeof(what), "P%d R%d: allocation %d max %d, reference has %d and %d", i, j,
+					allocation[i][j], max[i][j], oracle.allocation[i][j], oracle.max[i][j]);
+			} else if (need[i][j] != max[i][j] - allocation[i][j]) {
+				snprintf(what, sizeof(what), "P%d R%d: need %d, not max - allocation", i, j, need[i][j]);
+			} else if (resourceTable[j].allocated[i] != allocation[i][j]) {
+				snprintf(what, sizeof(what), "P%d R%d: resource table has %d allocated, not %d", i, j,
+					resourceTable[j].allocated[i], allocation[i][j]);
+			} else if (lane_get(packedAllocation[i], j) != allocation[i][j] ||
+					lane_get(packedNeed[i], j) != lane_get(lane_set(0, 0, need[i][j]), 0)) {
+				snprintf(what, sizeof(what), "P%d R%d: packed lanes are stale", i, j);
+			}
+		}
+		if (!what[0] && (heldTotal[i] != held || heldCount[i] != heldKinds)) {
+			snprintf(what, sizeof(what), "P%d: sparse view has %d instances of %d resources, not %d of %d", i,
+				heldTotal[i], heldCount[i], held, heldKinds);
+		}
+	}
+	for (int j = 0; j < NUM_RESOURCES && !what[0]; j++) {
+		int holding = 0;
+		for (int i = 0; i < 18; i++) holding += allocation[i][j] > 0;
+		if (holderCount[j] != holding) {
+			snprintf(what, sizeof(what), "R%d: sparse view lists %d holders, not %d", j, holderCount[j], holding);
+		}
+	}
+	if (!what[0] && stateHash != computeStateHash()) {
+		snprintf(what, sizeof(what), "state hash is stale");
+	}
+	if (what[0]) {
+		oracleDiverged(ev, 1, "%s", what);
+		oracleResync();
+	}
+}
+
+void oracleGrant(int i, const int *counts) {
+	FuzzEvent ev = {FUZZ_GIVE, i, 0, {0}};
+	memcpy(ev.counts, counts, sizeof(ev.counts));
+	oracleBefore = oracle;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (counts[j] > oracle.available[j] || counts[j] > oracle.max[i][j] - oracle.allocation[i][j]) {
+			oracleDiverged(&ev, 1, "granted %d of R%d with %d available and %d claimed", counts[j], j,
+				oracle.available[j], oracle.max[i][j] - oracle.allocation[i][j]);
+		}
+		oracle.available[j] -= counts[j];
+		oracle.allocation[i][j] += counts[j];
+	}
+	oracleCheckState(&ev);
+}
+
+void oracleRelease(int i, const int *counts) {
+	FuzzEvent ev = {FUZZ_RELEASE, i, 0, {0}};
+	memcpy(ev.counts, counts, sizeof(ev.counts));
+	oracleBefore = oracle;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		int n = counts[j] < oracle.allocation[i][j] ? counts[j] : oracle.allocation[i][j];
+		if (n <= 0) continue;
+		oracle.available[j] += n;
+		oracle.allocation[i][j] -= n;
+	}
+	oracleCheckState(&ev);
+}
+
+void oracleReclaim(int i) {
+	FuzzEvent ev = {FUZZ_RECLAIM, i, 0, {0}};
+	oracleBefore = oracle;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		oracle.available[j] += oracle.allocation[i][j];
+		oracle.allocation[i][j] = 0;
+	}
+	oracleCheckState(&ev);
+}
+
+void oracleClaim(int i, int j, int value) {
+	FuzzEvent ev = {FUZZ_MAX, i, j, {value}};
+	oracleBefore = oracle;
+	if (value < oracle.allocation[i][j]) {
+		oracleDiverged(&ev, 1, "claim of %d is below the %d held", value, oracle.allocation[i][j]);
+	}
+	oracle.max[i][j] = value;
+	oracleCheckState(&ev);
+}
+
+void oracleSlot(int i, pid_t pid) {
+	FuzzEvent ev = {pid != 0 ? FUZZ_SPAWN : FUZZ_FREE, i, 0, {0}};
+	oracleBefore = oracle;
+	for (int j = 0; pid == 0 && j < NUM_RESOURCES; j++) {
+		if (oracle.allocation[i][j] > 0) {
+			oracleDiverged(&ev, 1, "slot freed still holding %d of R%d", oracle.allocation[i][j], j);
+			break;
+		}
+	}
+	oracle.pid[i] = pid;
+	oracleCheckState(&ev);
+}
+
+//Preemption moves one instance; there's no single replay event for it, so it replays as a detection pass
+void oracleMove(int from, int to, int r) {
+	FuzzEvent ev = {FUZZ_DETECT, 0, 0, {0}};
+	oracleBefore = oracle;
+	if (oracle.allocation[from][r] <= 0) {
+		oracleDiverged(&ev, 1, "preempted R%d from P%d, which holds none", r, from);
+	}
+	oracle.allocation[from][r]--;
+	oracle.allocation[to][r]++;
+	oracleCheckState(&ev);
+}
+
+//Textbook banker's: grant each request in turn, then look for an order in which every live process finishes
+bool oracleReferenceSafe(int n, const int *slots, const int *counts) {
+	int work[NUM_RESOURCES];
+	int alloc[18][NUM_RESOURCES];
+	int needLeft[18][NUM_RESOURCES];
+	memcpy(work, oracle.available, sizeof(work));
+	memcpy(alloc, oracle.allocation, sizeof(alloc));
+	for (int i = 0; i < 18; i++) {
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			needLeft[i][j] = oracle.max[i][j] - alloc[i][j];
+		}
+	}
+	for (int k = 0; k < n; k++) {
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			int c = counts[k * NUM_RESOURCES + j];
+			if (c > work[j] || c > needLeft[slots[k]][j]) return false;
+			work[j] -= c;
+			alloc[slots[k]][j] += c;
+			needLeft[slots[k]][j] -= c;
+		}
+	}
+
+	bool finish[18];
+	for (int i = 0; i < 18; i++) {
+		finish[i] = oracle.pid[i] == 0;
+	}
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (int i = 0; i < 18; i++) {
+			if (finish[i]) continue;
+			bool fits = true;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				if (needLeft[i][j] > work[j]) fits = false;
+			}
+			if (!fits) continue;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				work[j] += alloc[i][j];
+			}
+			finish[i] = true;
+			progress = true;
+		}
+	}
+	for (int i = 0; i < 18; i++) {
+		if (!finish[i]) return false;
+	}
+	return true;
+}
+
+//slots[k] asked for counts[k * NUM_RESOURCES ...], all granted together; verdict is what the engine decided
+void oracleCheckDecision(int n, const int *slots, const int *counts, bool verdict) {
+	stat_oracle_decisions++;
+	if (oracleReferenceSafe(n, slots, counts) == verdict) return;
+	FuzzEvent failing[MAX_MESSAGE_BATCH + 1];
+	int failingCount = 0;
+	for (int k = 0; k < n; k++) {
+		failing[failingCount] = (FuzzEvent){n == 1 ? FUZZ_CHECK : FUZZ_MSG, slots[k], REQUEST_VECTOR, {0}};
+		memcpy(failing[failingCount].counts, &counts[k * NUM_RESOURCES], sizeof(failing[0].counts));
+		failingCount++;
+	}
+	if (n > 1) failing[failingCount++] = (FuzzEvent){FUZZ_FLUSH, 0, 0, {0}};
+	oracleBefore = oracle;
+	oracleDiverged(failing, failingCount, "%d request%s judged %s, reference says %s", n, n == 1 ? "" : "s",
+		verdict ? "safe" : "unsafe", verdict ? "unsafe" : "safe");
+}
+
+//Textbook detection: processes whose outstanding request can't be met, however the others finish
+void oracleCheckDetection(const int *deadlocked, int deadlockedCount) {
+	stat_oracle_decisions++;
+	int request[18][NUM_RESOURCES] = {{0}};
+	int work[NUM_RESOURCES];
+	bool finish[18];
+	for (int w = 0; w < waitQueueSize; w++) {
+		int i = oracleSlotOf(waitQueue[w].pid);
+		for (int j = 0; i != -1 && j < NUM_RESOURCES; j++) {
+			request[i][j] += waitQueue[w].counts[j];
+		}
+	}
+	memcpy(work, oracle.available, sizeof(work));
+	for (int i = 0; i < 18; i++) {
+		finish[i] = oracle.pid[i] == 0;
+	}
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (int i = 0; i < 18; i++) {
+			if (finish[i]) continue;
+			bool fits = true;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				if (request[i][j] > work[j]) fits = false;
+			}
+			if (!fits) continue;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				work[j] += oracle.allocation[i][j];
+			}
+			finish[i] = true;
+			progress = true;
+		}
+	}
+
+	uint32_t expected = 0, found = 0;
+	for (int i = 0; i < 18; i++) {
+		if (!finish[i]) expected |= (uint32_t)1 << i;
+	}
+	for (int k = 0; k < deadlockedCount; k++) {
+		found |= (uint32_t)1 << deadlocked[k];
+	}
+	if (found != expected) {
+		FuzzEvent ev = {FUZZ_DETECT, 0, 0, {0}};
+		oracleBefore = oracle;
+		oracleDiverged(&ev, 1, "detection found deadlock set 0x%x, reference has 0x%x", found, expected);
+	}
+}
+
+void oracleStart() {
+	oracleResync();
+	oracleEnabled = true;
+	oss_log("OSS: Reference oracle checking every allocator event\n");
+}
+
+//Fuzzer. Each run starts from empty tables and random settings, then generates events against the
+//engine's current state, so requests stay within claims and blocked workers stay quiet as they would
+//in a real run. States the protocol can reach but a normal run rarely does come from direct grants.
+struct oss_message fuzzBatch[MAX_MESSAGE_BATCH];
+int fuzzBatchCount = 0;
+
+bool fuzzBlocked(int slot) {
+	for (int w = 0; w < waitQueueSize; w++) {
+		if (waitQueue[w].pid == processTable[slot].pid) return true;
+	}
+	return false;
+}
+
+//Replies and preemption notices have nobody to read them
+void fuzzDiscardReplies() {
+	struct {
+		long mtype;
+		char body[256];
+	} msg;
+	for (int pass = 0; pass < 2; pass++) {
+		while (msgrcv(msqid, &msg, sizeof(msg.body), 0, IPC_NOWAIT | MSG_NOERROR) != -1);
+		flushOutbox();
+	}
+}
+
+//Apply one event; events that no longer make sense (a message from a free slot, say) are skipped
+void fuzzApply(const FuzzEvent *ev) {
+	int i = ev->slot;
+	bool live = ev->kind > FUZZ_POLICY && processTable[i].pid != 0;
+	setSimClock(simTimeNs() + 1000000);
+	switch (ev->kind) {
+		case FUZZ_STRATEGY:
+			deadlockStrategy = ev->slot;
+			break;
+		case FUZZ_RECOVERY:
+			recoveryMode = ev->slot;
+			break;
+		case FUZZ_POLICY:
+			waitPolicy = ev->slot;
+			break;
+		case FUZZ_SPAWN:
+			if (!live) occupySlot(i, FUZZ_PID_BASE + i);
+			break;
+		case FUZZ_FREE:
+			if (live) setSlotPid(i, 0);
+			break;
+		case FUZZ_MAX:
+			//A waiting worker can't change its claim or be handed more; its queued request was checked
+			//against the need it had when it blocked
+			if (live && !fuzzBlocked(i)) setMaxClaim(i, ev->command, ev->counts[0]);
+			break;
+		case FUZZ_GIVE: {
+			bool fits = live && !fuzzBlocked(i);
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				if (ev->counts[j] > available[j] || ev->counts[j] > need[i][j]) fits = false;
+			}
+			if (fits) applyGrant(i, ev->counts);
+			break;
+		}
+		case FUZZ_RELEASE:
+			if (live) releaseInstances(i, ev->counts);
+			break;
+		case FUZZ_RECLAIM:
+			if (live) reclaimAllocation(i);
+			break;
+		case FUZZ_BLOCK: {
+			bool fits = live && !fuzzBlocked(i);
+			int total = 0;
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				if (ev->counts[j] < 0 || ev->counts[j] > need[i][j]) fits = false;
+				total += ev->counts[j];
+			}
+			if (fits && total > 0) addVectorToWaitQueue(processTable[i].pid, ev->counts, -1);
+			break;
+		}
+		case FUZZ_MSG: {
+			//One message per worker per batch, never from a blocked worker
+			if (!live || fuzzBlocked(i) || fuzzBatchCount == MAX_MESSAGE_BATCH) break;
+			for (int k = 0; k < fuzzBatchCount; k++) {
+				if (fuzzBatch[k].pid == processTable[i].pid) return;
+			}
+			int total = 0, resourceId = 0;
+			for (int j = NUM_RESOURCES - 1; j >= 0; j--) {
+				if (ev->counts[j] < 0) return;
+				if (ev->counts[j] > 0) resourceId = j;
+				total += ev->counts[j];
+			}
+			if (total == 0 && ev->command != TERMINATE && ev->command != RELEASE_ALL_TERMINATE) return;
+			struct oss_message *msg = &fuzzBatch[fuzzBatchCount++];
+			memset(msg, 0, sizeof(*msg));
+			msg->mtype = OSS_MTYPE;
+			msg->pid = processTable[i].pid;
+			msg->command = ev->command;
+			msg->resourceId = resourceId;
+			memcpy(msg->counts, ev->counts, sizeof(msg->counts));
+			break;
+		}
+		case FUZZ_FLUSH: {
+			//A worker only asks for what its claim still allows; anything else since the message was
+			//generated (a direct grant, a preemption, a kill) may have changed that
+			int kept = 0;
+			for (int k = 0; k < fuzzBatchCount; k++) {
+				struct oss_message *msg = &fuzzBatch[k];
+				int slot = findProcessIndex(msg->pid);
+				bool valid = slot != -1 && !fuzzBlocked(slot);
+				for (int j = 0; valid && j < NUM_RESOURCES; j++) {
+					if ((msg->command == REQUEST_RESOURCE || msg->command == REQUEST_VECTOR) && msg->counts[j] > need[slot][j]) {
+						valid = false;
+					}
+				}
+				if (valid) fuzzBatch[kept++] = *msg;
+			}
+			if (kept > 0) processMessageBatch(fuzzBatch, kept);
+			fuzzBatchCount = 0;
+			break;
+		}
+		case FUZZ_CHECK: {
+			if (!live) break;
+			bool safe = cachedIsSafe(i, ev->counts);
+			oracleCheckDecision(1, &i, ev->counts, safe);
+			break;
+		}
+		case FUZZ_DETECT:
+			detectAndResolveDeadlock();
+			break;
+		case FUZZ_WAKE:
+			processWaitQueue();
+			break;
+	}
+	fuzzDiscardReplies();
+}
+
+//Empty tables, empty cache and wait queue, the oracle in step; returns with no divergence counted
+void fuzzReset() {
+	initAllocatorTables();
+	waitQueueSize = 0;
+	waitQueueDirty = false;
+	replyBatchCount = 0;
+	departingCount = 0;
+	fuzzBatchCount = 0;
+	leasesOutstanding = false;
+	memset(safetyCache, 0, sizeof(safetyCache));
+	safetyCacheTick = 0;
+	oracleResync();
+	stat_oracle_events = 0;
+	stat_oracle_divergences = 0;
+}
+
+bool fuzzReplay(const FuzzEvent *events, int n) {
+	fuzzReset();
+	for (int k = 0; k < n && stat_oracle_divergences == 0; k++) {
+		fuzzApply(&events[k]);
+	}
+	return stat_oracle_divergences > 0;
+}
+
+//A random count vector, each entry at most limit[j] (and at most cap), or all zero
+void fuzzCounts(unsigned int *seed, int *counts, const int *limit, int cap) {
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		int top = limit[j] < cap ? limit[j] : cap;
+		counts[j] = (top > 0 && rand_r(seed) % 3 == 0) ? rand_r(seed) % (top + 1) : 0;
+	}
+}
+
+//Next event for the current engine state
+FuzzEvent fuzzNextEvent(unsigned int *seed) {
+	FuzzEvent ev = {FUZZ_FLUSH, 0, 0, {0}};
+	int liveSlots[18], liveCount = 0, freeSlots[18], freeCount = 0;
+	for (int i = 0; i < 18; i++) {
+		if (processTable[i].pid != 0) liveSlots[liveCount++] = i;
+		else freeSlots[freeCount++] = i;
+	}
+	int roll = rand_r(seed) % 100;
+	if (liveCount == 0 || (roll < 12 && freeCount > 0)) {
+		ev.kind = FUZZ_SPAWN;
+		ev.slot = freeSlots[rand_r(seed) % freeCount];
+		return ev;
+	}
+	ev.slot = liveSlots[rand_r(seed) % liveCount];
+	int held[NUM_RESOURCES], room[NUM_RESOURCES];
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		held[j] = allocation[ev.slot][j];
+		room[j] = need[ev.slot][j] < available[j] ? need[ev.slot][j] : available[j];
+	}
+	if (roll < 20) {
+		ev.kind = FUZZ_DETECT;
+	} else if (roll < 26) {
+		ev.kind = FUZZ_WAKE;
+	} else if (roll < 34) {
+		ev.kind = FUZZ_CHECK;
+		fuzzCounts(seed, ev.counts, need[ev.slot], 3);
+	} else if (roll < 39) {
+		ev.kind = FUZZ_GIVE;
+		fuzzCounts(seed, ev.counts, room, NUM_INSTANCES);
+	} else if (roll < 45) {
+		//Queue part of the remaining claim outright; granted requests rarely leave anyone waiting,
+		//and detection needs waiters to have anything to find
+		ev.kind = FUZZ_BLOCK;
+		if (rand_r(seed) % 2) {
+			memcpy(ev.counts, need[ev.slot], sizeof(ev.counts));
+		} else {
+			fuzzCounts(seed, ev.counts, need[ev.slot], NUM_INSTANCES);
+		}
+	} else if (roll < 92 || fuzzBatchCount == 0) {
+		ev.kind = FUZZ_MSG;
+		int pick = rand_r(seed) % 100;
+		if (pick < 12) {
+			ev.command = CLAIM_RESOURCES;
+			int cap[NUM_RESOURCES];
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				cap[j] = NUM_INSTANCES - held[j];
+				ev.counts[j] = held[j];
+			}
+			int extra[NUM_RESOURCES];
+			fuzzCounts(seed, extra, cap, 4);
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				ev.counts[j] += extra[j];
+			}
+		} else if (pick < 52) {
+			ev.command = REQUEST_VECTOR;
+			fuzzCounts(seed, ev.counts, need[ev.slot], 3);
+		} else if (pick < 67) {
+			ev.command = REQUEST_RESOURCE;
+			ev.counts[rand_r(seed) % NUM_RESOURCES] = 1;
+		} else if (pick < 80) {
+			ev.command = RELEASE_VECTOR;
+			fuzzCounts(seed, ev.counts, held, NUM_INSTANCES);
+		} else if (pick < 88) {
+			ev.command = RELEASE_RESOURCE;
+			ev.counts[rand_r(seed) % NUM_RESOURCES] = 1;
+		} else if (pick < 95) {
+			ev.command = TERMINATE;
+		} else {
+			ev.command = RELEASE_ALL_TERMINATE;
+		}
+	} else {
+		ev.kind = FUZZ_FLUSH;
+		ev.slot = 0;
+	}
+	return ev;
+}
+
+//Generate and apply one run, recording the events. Returns the number of events.
+int fuzzGenerate(unsigned int seed, FuzzEvent *events) {
+	fuzzReset();
+	int n = 0;
+	events[n++] = (FuzzEvent){FUZZ_STRATEGY, rand_r(&seed) % 3, 0, {0}};
+	events[n++] = (FuzzEvent){FUZZ_RECOVERY, rand_r(&seed) % 2, 0, {0}};
+	events[n++] = (FuzzEvent){FUZZ_POLICY, rand_r(&seed) % 4, 0, {0}};
+	for (int k = 0; k < n; k++) {
+		fuzzApply(&events[k]);
+	}
+	while (n < FUZZ_RUN_EVENTS && stat_oracle_divergences == 0) {
+		events[n] = fuzzNextEvent(&seed);
+		fuzzApply(&events[n]);
+		n++;
+	}
+	if (stat_oracle_divergences == 0 && fuzzBatchCount > 0) {
+		events[n] = (FuzzEvent){FUZZ_FLUSH, 0, 0, {0}};
+		fuzzApply(&events[n++]);
+	}
+	return n;
+}
+
+//Drop events one at a time as long as the run still diverges; the settings stay
+int fuzzShrink(FuzzEvent *events, int n) {
+	FuzzEvent trial[FUZZ_MAX_EVENTS];
+	bool shrunk = true;
+	while (shrunk) {
+		shrunk = false;
+		for (int k = n - 1; k >= 0; k--) {
+			if (events[k].kind <= FUZZ_POLICY) continue;
+			memcpy(trial, events, k * sizeof(FuzzEvent));
+			memcpy(trial + k, events + k + 1, (n - k - 1) * sizeof(FuzzEvent));
+			if (fuzzReplay(trial, n - 1)) {
+				memcpy(events, trial, (n - 1) * sizeof(FuzzEvent));
+				n--;
+				shrunk = true;
+			}
+		}
+	}
+	fuzzReplay(events, n); //leave oracleDivergence describing the minimal run
+	return n;
+}
+
+//-Z runs[:seed] fuzzes, -Z file replays. Returns the exit status.
+int runFuzzer(const char *spec) {
+	static FuzzEvent events[FUZZ_MAX_EVENTS];
+	fuzzing = true;
+	logMuted = true;
+	oracleEnabled = true;
+	int status = 0;
+
+	if (spec[0] < '0' || spec[0] > '9') {
+		int n = readFuzzEvents(spec, events, FUZZ_MAX_EVENTS);
+		if (n < 0) return 1;
+		if (fuzzReplay(events, n)) {
+			printf("Replay of %s diverged at %s\n", spec, oracleDivergence);
+			status = 1;
+		} else {
+			printf("Replay of %s: %d events, %d decisions checked, no divergence\n", spec, n, stat_oracle_decisions);
+		}
+	} else {
+		int runs = atoi(spec);
+		const char *colon = strchr(spec, ':');
+		unsigned int seed = colon ? (unsigned int)strtoul(colon + 1, NULL, 10) : runId;
+		int totalEvents = 0;
+		for (int r = 0; r < runs && status == 0; r++) {
+			int n = fuzzGenerate(seed + r, events);
+			totalEvents += n;
+			if (stat_oracle_divergences == 0) continue;
+
+			char first[256], path[64];
+			snprintf(first, sizeof(first), "%s", oracleDivergence);
+			n = fuzzShrink(events, n);
+			snprintf(path, sizeof(path), "oracle-%u.replay", runId);
+			FILE *fp = fopen(path, "w");
+			if (fp) {
+				fprintf(fp, "# oss fuzz seed %u, minimal replay; run it with ./oss -Z %s\n# %s\n", seed + r, path, oracleDivergence);
+				writeFuzzEvents(fp, events, n);
+				fclose(fp);
+			}
+			printf("Fuzz run %d (seed %u) diverged at %s\n", r, seed + r, first);
+			printf("Minimal replay, %d events, written to %s:\n", n, path);
+			writeFuzzEvents(stdout, events, n);
+			printf("It diverges at %s\n", oracleDivergence);
+			status = 1;
+		}
+		if (status == 0) {
+			printf("Fuzz: %d runs from seed %u, %d events, %d decisions checked against the reference, no divergence\n",
+				runs, seed, totalEvents, stat_oracle_decisions);
+		}
+		printf("Safety kernel %s, cache %s\n", safetyKernelName, cacheModeNames[cacheMode]);
+	}
+	initAllocatorTables(); //no fuzzed pids left for shutdown to signal
+	return status;
+}
+
+int countRunningChildren() {
+	int running = 0;
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		if (processTable[i].pid != 0) running++;
+	}
+	return running;
+}
+
+//Fork and exec one worker into slot. adopt makes it take over sharedState->adopt[slot].
+pid_t spawnWorker(int workerIndex, int slot, bool adopt) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		//Child process
+		placeWorker(slot);
+		char bound_B_str[20];
+		char shmid_str[20];
+		char msqid_str[20];
+		char runId_str[20];
+		char workerIndex_str[20];
+		char adoptSlot_str[20];
+		sprintf(bound_B_str, "%d", 100000);
+		sprintf(shmid_str, "%d", shmid);
+		sprintf(msqid_str, "%d", msqid);
+		sprintf(runId_str, "%u", runId);
+		sprintf(workerIndex_str, "%d", workerIndex); //seeds the worker's RNG
+		sprintf(adoptSlot_str, "%d", slot);
+		sigprocmask(SIG_SETMASK, &originalSigmask, NULL); //workers must see SIGTERM
+		if (adopt) {
+			execl("./user_proc", "user_proc", bound_B_str, shmid_str, msqid_str, runId_str,
+					workerIndex_str, workloadProfile ? workloadProfile : "", adoptSlot_str, NULL);
+		} else if (workloadProfile) {
+			execl("./user_proc", "user_proc", bound_B_str, shmid_str, msqid_str, runId_str,
+					workerIndex_str, workloadProfile, NULL);
+		} else {
+			execl("./user_proc", "user_proc", bound_B_str, shmid_str, msqid_str, runId_str, NULL);
+		}
+		perror("execl");
+		_exit(1); //don't run oss's atexit cleanup in the child
+	}
+	if (pid < 0) perror("fork");
+	return pid;
+}
+
+//A new worker starts in slot with the default claim until it declares its own
+void occupySlot(int slot, pid_t pid) {
+	setSlotPid(slot, pid);
+	startLifecycle(slot);
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		setMaxClaim(slot, j, DEFAULT_MAX_CLAIM);
+	}
+}
+
+//Launch one new worker into a free slot
+void launchWorker() {
+	int slot = -1;
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		if (processTable[i].pid == 0) {
+			slot = i;
+			break;
+		}
+	}
+	if (slot == -1) return;
+	pid_t pid = spawnWorker(totalProcesses, slot, false); //launch order seeds the worker's RNG
+	if (pid > 0) {
+		//Parent process
+		occupySlot(slot, pid);
+		oss_log_verbose("OSS: Launched child process %d in slot %d\n", pid, slot);
+		totalProcesses++;
+		stat_processes_launched++;
+	}
+}
+
+//Checkpoint/restore (-K, -k). The snapshot is one fixed-layout record, written through an mmap of a
+//temporary file and renamed into place, so a reader only ever sees a complete snapshot.
+#define CHECKPOINT_MAGIC 0x4F53534B
+#define CHECKPOINT_VERSION 1
+char *checkpointFile = NULL; //-K file@ms
+long long checkpointAtMs = 0;
+char *restoreFile = NULL; //-k file
+
+//Counters carried across a checkpoint, in snapshot order (append only; bump CHECKPOINT_VERSION otherwise)
+int *checkpointCounters[] = {
+	&stat_requests_granted_immediately, &stat_requests_granted_after_wait,
+	&stat_deadlock_terminations, &stat_normal_terminations,
+	&stat_deadlock_detection_runs, &stat_deadlock_processes_terminated,
+	&stat_exits_deadlock_killed, &stat_exits_crashed, &stat_exits_unannounced, &stat_exits_at_shutdown,
+	&stat_processes_launched, &stat_claims_accepted, &stat_claims_rejected, &stat_legacy_claim_denials,
+	&stat_preemptions, &stat_safety_checks, &stat_optimistic_grants,
+	&stat_admission_delays, &stat_admission_rejects, &stat_admission_fast_launches,
+};
+#define CHECKPOINT_COUNTERS ((int)(sizeof(checkpointCounters) / sizeof(checkpointCounters[0])))
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int size; //sizeof(Checkpoint), so a snapshot from a different build is rejected
+	unsigned int runId; //run that wrote it
+	long long simNs;
+	long long lastLaunchNs;
+	int totalProcesses;
+	PCB processTable[18];
+	int max[18][NUM_RESOURCES];
+	int allocation[18][NUM_RESOURCES];
+	int available[NUM_RESOURCES];
+	ResourceDescriptor resourceTable[NUM_RESOURCES];
+	ResourceProfile resourceProfile[NUM_RESOURCES];
+	long long heldSince[18][NUM_RESOURCES][NUM_INSTANCES];
+	int heldSinceHead[18][NUM_RESOURCES];
+	long long waitTotalNs;
+	int counters[CHECKPOINT_COUNTERS];
+} Checkpoint;
+
+bool writeCheckpoint(const char *path) {
+	char tmpPath[PATH_MAX];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	int fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror("open checkpoint");
+		return false;
+	}
+	if (ftruncate(fd, sizeof(Checkpoint)) == -1) {
+		perror("ftruncate checkpoint");
+		close(fd);
+		return false;
+	}
+	Checkpoint *cp = mmap(NULL, sizeof(Checkpoint), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (cp == MAP_FAILED) {
+		perror("mmap checkpoint");
+		close(fd);
+		return false;
+	}
+
+	cp->magic = CHECKPOINT_MAGIC;
+	cp->version = CHECKPOINT_VERSION;
+	cp->size = sizeof(Checkpoint);
+	cp->runId = runId;
+	cp->simNs = simTimeNs();
+	cp->lastLaunchNs = last_launch_ns;
+	cp->totalProcesses = totalProcesses;
+	memcpy(cp->processTable, processTable, sizeof(processTable));
+	memcpy(cp->max, max, sizeof(max));
+	memcpy(cp->allocation, allocation, sizeof(allocation));
+	memcpy(cp->available, available, sizeof(available));
+	memcpy(cp->resourceTable, resourceTable, sizeof(resourceTable));
+	memcpy(cp->resourceProfile, resourceProfile, sizeof(resourceProfile));
+	memcpy(cp->heldSince, heldSince, sizeof(heldSince));
+	memcpy(cp->heldSinceHead, heldSinceHead, sizeof(heldSinceHead));
+	cp->waitTotalNs = stat_wait_total_ns;
+	for (int k = 0; k < CHECKPOINT_COUNTERS; k++) {
+		cp->counters[k] = *checkpointCounters[k];
+	}
+
+	bool ok = msync(cp, sizeof(Checkpoint), MS_SYNC) == 0;
+	if (!ok) perror("msync checkpoint");
+	munmap(cp, sizeof(Checkpoint));
+	close(fd);
+	if (ok && rename(tmpPath, path) == -1) {
+		perror("rename checkpoint");
+		ok = false;
+	}
+	if (!ok) unlink(tmpPath);
+	return ok;
+}
+
+//Load a snapshot into the freshly initialized tables and re-spawn a worker for every live process.
+//Each new worker adopts its slot's allocation and claim; requests that were blocked are not carried over
+//(the checkpoint is only taken with an empty wait queue).
+bool restoreCheckpoint(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		perror("open checkpoint");
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size != (off_t)sizeof(Checkpoint)) {
+		fprintf(stderr, "OSS: %s is not a checkpoint from this build\n", path);
+		close(fd);
+		return false;
+	}
+	const Checkpoint *cp = mmap(NULL, sizeof(Checkpoint), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (cp == MAP_FAILED) {
+		perror("mmap checkpoint");
+		return false;
+	}
+	if (cp->magic != CHECKPOINT_MAGIC || cp->version != CHECKPOINT_VERSION || cp->size != sizeof(Checkpoint)) {
+		fprintf(stderr, "OSS: %s has an unknown checkpoint format (version %u)\n", path, cp->version);
+		munmap((void *)cp, sizeof(Checkpoint));
+		return false;
+	}
+
+	setSimClock(cp->simNs);
+	wheelTick = cp->simNs / WHEEL_TICK_NS; //timers are armed relative to the restored time
+	last_launch_ns = cp->lastLaunchNs;
+	totalProcesses = cp->totalProcesses;
+	memcpy(available, cp->available, sizeof(available));
+	memcpy(resourceTable, cp->resourceTable, sizeof(resourceTable));
+	for (int i = 0; i < 18; i++) {
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			setMaxClaim(i, j, cp->max[i][j]);
+			setAllocation(i, j, cp->allocation[i][j]);
+		}
+	}
+	//After the setters, which would otherwise count the restored allocation as new grants
+	memcpy(resourceProfile, cp->resourceProfile, sizeof(resourceProfile));
+	memcpy(heldSince, cp->heldSince, sizeof(heldSince));
+	memcpy(heldSinceHead, cp->heldSinceHead, sizeof(heldSinceHead));
+	stat_wait_total_ns = cp->waitTotalNs;
+	for (int k = 0; k < CHECKPOINT_COUNTERS; k++) {
+		*checkpointCounters[k] = cp->counters[k];
+	}
+
+	for (int i = 0; i < 18; i++) {
+		if (cp->processTable[i].pid == 0) continue;
+		memcpy(sharedState->adopt[i].held, allocation[i], sizeof(allocation[i]));
+		memcpy(sharedState->adopt[i].claim, max[i], sizeof(max[i]));
+		pid_t pid = spawnWorker(maxProcesses + i, i, true); //past every launch index, so no RNG stream repeats
+		if (pid <= 0) {
+			reclaimAllocation(i);
+			continue;
+		}
+		processTable[i] = cp->processTable[i];
+		processTable[i].pid = 0;
+		setSlotPid(i, pid);
+		resumeLifecycle(i); //same lifetime as far as the report goes, launched when the original was
+		stat_workers_respawned++;
+		oss_log_verbose("OSS: Re-spawned process %d in slot %d (was %d)\n", pid, i, cp->processTable[i].pid);
+	}
+	oss_log("OSS: Restored run %u from %s at time %u:%u, %d workers re-spawned\n",
+			cp->runId, path, simClock->seconds, simClock->nanoseconds, stat_workers_respawned);
+	munmap((void *)cp, sizeof(Checkpoint));
+	return true;
+}
+
+//Periodic oss duties, driven by the timer wheel
+SimTimer launchTimer;
+SimTimer detectionTimer;
+SimTimer snapshotTimer;
+SimTimer simulationEndTimer;
+SimTimer queueSampleTimer;
+SimTimer leaseTimer;
+SimTimer checkpointTimer;
+bool simulationOver = false;
+int detectionIntervalMs = 1000; //changeable with 'detect' on the control channel
+
+//Launch when the interval is up (twice as often while nothing is blocked and fewer than half the slots are used)
+void launchTimerFired(SimTimer *timer) {
+	if (totalProcesses + stat_admission_rejects >= maxProcesses) {
+		return; //every launch has happened or been rejected; don't re-arm
+	}
+	long long now_ns = simTimeNs();
+	long long elapsed_ns = now_ns - last_launch_ns;
+	long long interval_ns = (long long)launchIntervalMs * 1000000; // Convert ms to ns
+	bool idle = (waitQueueSize == 0 && countRunningChildren() < MAX_PROCESSES / 2);
+	if (idle) interval_ns /= 2;
+
+	if (elapsed_ns < interval_ns) {
+		scheduleTimer(timer, (interval_ns - elapsed_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS);
+		return;
+	}
+	if (countRunningChildren() >= MAX_PROCESSES) {
+		scheduleTimer(timer, 1); //check again next tick, a slot may free up
+		return;
+	}
+
+	int admit = admissionDecision(now_ns);
+	if (admit == ADMIT_DELAY) {
+		scheduleTimer(timer, 1);
+		return;
+	}
+	if (admit == ADMIT_REJECT) {
+		stat_admission_rejects++;
+	} else {
+		if (idle && elapsed_ns < (long long)launchIntervalMs * 1000000) stat_admission_fast_launches++;
+		launchWorker();
+	}
+	last_launch_ns = now_ns;
+	//Wake at the earliest the next launch could be due; the interval check above re-arms if it isn't
+	scheduleTimer(timer, launchIntervalMs / 2);
+}
+
+// Deadlock detection (every second), unless banker's avoidance already rules deadlock out
+void detectionTimerFired(SimTimer *timer) {
+	if (verbose) {
+		printf("OSS: Running deadlock detection at time %u:%u\n", 
+			   simClock->seconds, simClock->nanoseconds);
+	}
+	detectAndResolveDeadlock();
+}
+
+//Resource table output (every half second, verbose only)
+void snapshotTimerFired(SimTimer *timer) {
+	printResourceTable();
+	printProcessTable();
+}
+
+//print resource and process tables every 20 grants
+void grantReportTimerFired(SimTimer *timer) {
+	printResourceTable();
+	printProcessTable();
+	printStatistics();
+}
+
+//Sample the message queue depth (every 100 ms)
+void queueSampleTimerFired(SimTimer *timer) {
+	sampleQueueDepth();
+}
+
+void leaseTimerFired(SimTimer *timer) {
+	reconcileLeases();
+}
+
+//Write the checkpoint at the first tick at or after -K's time with nothing blocked and no reply pending
+void checkpointTimerFired(SimTimer *timer) {
+	if (waitQueueSize > 0 || outboxCount > 0) {
+		stat_checkpoint_deferrals++;
+		scheduleTimer(timer, 1);
+		return;
+	}
+	revokeAllLeases(); //a worker can't take a lease with it across a restore
+	if (writeCheckpoint(checkpointFile)) {
+		oss_log("OSS: Checkpoint written to %s at time %u:%u\n", checkpointFile, simClock->seconds, simClock->nanoseconds);
+	}
+}
+
+void simulationEndTimerFired(SimTimer *timer) {
+	simulationOver = true;
+}
+
+void setupTimers() {
+	launchTimer = (SimTimer){.name = "launch", .fire = launchTimerFired};
+	detectionTimer = (SimTimer){.name = "detection", .fire = detectionTimerFired};
+	snapshotTimer = (SimTimer){.name = "snapshot", .fire = snapshotTimerFired};
+	grantReportTimer = (SimTimer){.name = "grant report", .fire = grantReportTimerFired};
+	simulationEndTimer = (SimTimer){.name = "simulation end", .fire = simulationEndTimerFired};
+	queueSampleTimer = (SimTimer){.name = "queue sample", .fire = queueSampleTimerFired};
+	leaseTimer = (SimTimer){.name = "lease reconcile", .fire = leaseTimerFired};
+	checkpointTimer = (SimTimer){.name = "checkpoint", .fire = checkpointTimerFired};
+
+	scheduleTimer(&launchTimer, 1);
+	if (deadlockStrategy != STRATEGY_AVOID) {
+		schedulePeriodicTimer(&detectionTimer, detectionIntervalMs);
+	}
+	if (verbose) {
+		schedulePeriodicTimer(&snapshotTimer, 500);
+	}
+	schedulePeriodicTimer(&queueSampleTimer, 100);
+	if (leaseSize > 0) {
+		schedulePeriodicTimer(&leaseTimer, LEASE_RECONCILE_MS);
+	}
+	if (checkpointFile) {
+		scheduleTimer(&checkpointTimer, checkpointAtMs - wheelTick);
+	}
+	scheduleTimer(&simulationEndTimer, maxRuntimeSeconds * 1000LL - wheelTick); //absolute, so a restore doesn't restart it
+}
+
+//Control channel (-c). A FIFO read by the main loop, one command per line, e.g.
+//  echo 'verbose on' > oss.ctl
+//Commands take effect at the next simulated millisecond; the response goes to the log.
+#define CONTROL_LINE_MAX 256
+char *controlPath = NULL;
+int controlFd = -1;
+bool controlCreatedFifo = false;
+char controlBuf[CONTROL_LINE_MAX];
+int controlLen = 0;
+
+void setupControlChannel() {
+	if (mkfifo(controlPath, 0600) == 0) {
+		controlCreatedFifo = true;
+	} else if (errno != EEXIST) {
+		perror("mkfifo");
+		exit(1);
+	}
+	//Opened read-write so the FIFO never reports end-of-file between writers
+	controlFd = open(controlPath, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (controlFd == -1) {
+		perror("open control channel");
+		exit(1);
+	}
+	struct stat st;
+	if (fstat(controlFd, &st) == -1 || !S_ISFIFO(st.st_mode)) {
+		fprintf(stderr, "%s exists and is not a FIFO\n", controlPath);
+		exit(1);
+	}
+}
+
+void closeControlChannel() {
+	if (controlFd != -1) {
+		close(controlFd);
+		controlFd = -1;
+	}
+	if (controlCreatedFifo) {
+		unlink(controlPath);
+		controlCreatedFifo = false;
+	}
+}
+
+void runControlCommand(char *line) {
+	char *cmd = strtok(line, " \t");
+	char *arg = strtok(NULL, " \t");
+	if (cmd == NULL) return;
+	stat_control_commands++;
+
+	if (strcmp(cmd, "verbose") == 0 && arg) {
+		verbose = strcmp(arg, "on") == 0 || strcmp(arg, "1") == 0;
+		if (verbose) schedulePeriodicTimer(&snapshotTimer, 500);
+		else cancelTimer(&snapshotTimer);
+		oss_log("OSS: control: verbose %s\n", verbose ? "on" : "off");
+	} else if (strcmp(cmd, "interval") == 0 && arg && atoi(arg) > 0) {
+		launchIntervalMs = atoi(arg);
+		if (launchTimer.armed) scheduleTimer(&launchTimer, 1); //re-evaluate against the new interval
+		oss_log("OSS: control: launch interval %d ms\n", launchIntervalMs);
+	} else if (strcmp(cmd, "detect") == 0 && arg && atoi(arg) >= 0) {
+		detectionIntervalMs = atoi(arg);
+		cancelTimer(&detectionTimer);
+		if (detectionIntervalMs > 0) schedulePeriodicTimer(&detectionTimer, detectionIntervalMs);
+		oss_log("OSS: control: deadlock detection every %d ms%s\n", detectionIntervalMs,
+				detectionIntervalMs == 0 ? " (off)" : "");
+	} else if (strcmp(cmd, "policy") == 0 && arg) {
+		int found = -1;
+		for (int k = 0; k < (int)(sizeof(policyNames) / sizeof(policyNames[0])); k++) {
+			if (strcmp(arg, policyNames[k]) == 0) found = k;
+		}
+		if (found == -1) {
+			oss_log("OSS: control: unknown wait queue policy '%s'\n", arg);
+			return;
+		}
+		waitPolicy = found;
+		rekeyWaitQueue();
+		waitQueueDirty = true;
+		oss_log("OSS: control: wait queue policy %s\n", policyNames[waitPolicy]);
+	} else if (strcmp(cmd, "snapshot") == 0) {
+		printResourceTable();
+		printProcessTable();
+	} else if (strcmp(cmd, "stats") == 0) {
+		printStatistics();
+	} else if (strcmp(cmd, "checkpoint") == 0 && arg && federatedPartitions > 0) {
+		//The primary only holds its own partition's allocations; a restore from that would diverge, as with -K
+		oss_log("OSS: control: checkpoint can't be taken with -F\n");
+	} else if (strcmp(cmd, "checkpoint") == 0 && arg) {
+		static char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s", arg);
+		checkpointFile = path;
+		scheduleTimer(&checkpointTimer, 1); //waits for a quiet tick like -K
+		oss_log("OSS: control: checkpoint to %s requested\n", checkpointFile);
+	} else if ((strcmp(cmd, "extend") == 0 || strcmp(cmd, "runtime") == 0) && arg && atoi(arg) > 0) {
+		maxRuntimeSeconds = (cmd[0] == 'e' ? maxRuntimeSeconds : 0) + atoi(arg);
+		scheduleTimer(&simulationEndTimer, maxRuntimeSeconds * 1000LL - wheelTick);
+		oss_log("OSS: control: run ends at %d simulated seconds\n", maxRuntimeSeconds);
+	} else if (strcmp(cmd, "stop") == 0) {
+		simulationOver = true;
+		oss_log("OSS: control: stop requested\n");
+	} else {
+		stat_control_commands--;
+		oss_log("OSS: control: unknown command '%s'\n", cmd);
+	}
+}
+
+//Run every complete line waiting in the FIFO; a partial line waits for the rest
+void handleControlCommands() {
+	ssize_t n;
+	while ((n = read(controlFd, controlBuf + controlLen, sizeof(controlBuf) - 1 - controlLen)) > 0) {
+		controlLen += n;
+		char *start = controlBuf;
+		char *newline;
+		while ((newline = memchr(start, '\n', controlBuf + controlLen - start)) != NULL) {
+			*newline = '\0';
+			if (newline > start && newline[-1] == '\r') newline[-1] = '\0';
+			while (isspace((unsigned char)*start)) start++;
+			runControlCommand(start);
+			start = newline + 1;
+		}
+		controlLen -= start - controlBuf;
+		memmove(controlBuf, start, controlLen);
+		if (controlLen == (int)sizeof(controlBuf) - 1) {
+			oss_log("OSS: control: line too long, discarded\n");
+			controlLen = 0;
+		}
+	}
+}
+
+//Wake sleeping workers once the earliest simulated deadline has passed (sim and ff pacing)
+void wakeDueSleepers() {
+	PacingState *pacing = &sharedState->pacing;
+	if (atomic_load(&pacing->earliestNs) > simTimeNs()) return;
+	//Clear before bumping the sequence: a worker that re-publishes after reading the new sequence survives
+	atomic_store(&pacing->earliestNs, INT64_MAX);
+	//Everyone woken stops counting as asleep right now, not once it gets to run: until a due worker has
+	//run, fast-forward must treat it as busy. Workers not yet due join the new generation again.
+	uint64_t word = atomic_load(&pacing->sleepers);
+	while (!atomic_compare_exchange_weak(&pacing->sleepers, &word, SLEEPERS_WORD(SLEEPERS_GEN(word) + 1, 0))) {
+	}
+	atomic_fetch_add(&pacing->wakeSeq, 1);
+	syscall(SYS_futex, (uint32_t *)&pacing->wakeSeq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	stat_pacing_wakeups++;
+}
+
+//Fast-forward: while every live worker sleeps on a deadline or waits in the queue and oss has nothing
+//pending, nothing can happen until the next deadline or timer, so run the clock up to it without
+//touching the message queue. Stops after any timer fires so its effects are handled normally.
+void fastForward() {
+	PacingState *pacing = &sharedState->pacing;
+	int running = countRunningChildren();
+	while (1) {
+		int sleepers = SLEEPERS_COUNT(atomic_load(&pacing->sleepers));
+		long long earliest = atomic_load(&pacing->earliestNs);
+		if (sleepers + waitQueueSize < running) return; //someone is busy
+		if (earliest == INT64_MAX && sleepers > 0) return; //a woken worker hasn't re-published yet
+		if (earliest <= simTimeNs() + WHEEL_TICK_NS) return; //due next tick
+		int fires = stat_timer_fires;
+		advanceSimClock(WHEEL_TICK_NS);
+		stat_fast_forward_ms++;
+		advanceTimerWheel();
+		if (stat_timer_fires != fires || simulationOver) return;
+	}
+}
+
+//Federation (-F k). Resources are dealt round-robin to k oss processes, each serving requests for its own
+//resources on its own message queue. The primary (partition 0) launches workers, takes their claims and
+//exits, and forks the other partitions before the first worker starts; workers route each request to
+//the owner's queue. Partitions talk over a mesh of Unix-domain datagram sockets.
+//No partition sees the whole wait-for graph, so each detection round the primary asks every partition
+//for a snapshot of its blocked workers and holders and runs the usual reduction over all of them. With
+//several instances per resource a waiter can be freed by any holder, so a cycle of waits alone is not a
+//deadlock. Snapshots are taken at slightly different times, so a worker is only killed once two
+//consecutive rounds find it deadlocked on the same wait.
+#define FED_GONE 1 //primary -> all: pid is gone, reclaim what it held
+#define FED_ROUND 2 //primary -> all: send a snapshot for this round
+#define FED_SNAPSHOT 3 //partition -> primary: FedSnapshot
+
+typedef struct {
+	int type;
+	int from; //sending partition
+	int round;
+	pid_t pid; //FED_GONE
+} FedMessage;
+
+typedef struct {
+	pid_t pid;
+	long long enqueueNs; //identifies the wait, so a worker that moved on doesn't look stuck
+	int deficit[NUM_RESOURCES]; //instances missing of each resource this partition owns
+} FedBlocked;
+
+typedef struct {
+	FedMessage head;
+	int blockedCount;
+	FedBlocked blocked[MAX_PROCESSES];
+	pid_t slotPid[MAX_PROCESSES];
+	int held[MAX_PROCESSES][NUM_RESOURCES]; //by the partition's slot, owned resources only
+} FedSnapshot;
+
+int fedSock[MAX_PARTITIONS][MAX_PARTITIONS]; //fedSock[p][q]: p's end of the socket between p and q
+pid_t partitionPids[MAX_PARTITIONS];
+bool partitionsStopping = false;
+int fedRound = 0;
+FedSnapshot fedSnapshots[MAX_PARTITIONS]; //primary: this round's snapshots
+bool fedHaveSnapshot[MAX_PARTITIONS];
+FedBlocked fedSuspects[MAX_PROCESSES]; //primary: workers the last complete round found deadlocked
+int fedSuspectCount = 0;
+PartitionStats fedStats; //this process's own counters
+
+void fedSend(int to, const void *msg, size_t size) {
+	//Never block: a lost GONE is caught by the dead-worker sweep, a lost snapshot by the next round
+	if (send(fedSock[partitionId][to], msg, size, MSG_DONTWAIT) == -1 && errno != EAGAIN) {
+		perror("send federation");
+	}
+}
+
+void fedBroadcast(FedMessage *msg) {
+	msg->from = partitionId;
+	for (int q = 0; q < federatedPartitions; q++) {
+		if (q != partitionId) fedSend(q, msg, sizeof(*msg));
+	}
+}
+
+//Primary: a worker left its slot, so every partition can drop it
+void federationSlotFreed(pid_t pid) {
+	if (partitionsStopping) return; //nobody left to tell
+	FedMessage msg = {.type = FED_GONE, .pid = pid};
+	fedBroadcast(&msg);
+}
+
+//What this partition knows: who is blocked on what, and who holds its resources
+void fedTakeSnapshot(FedSnapshot *snap, int round) {
+	memset(snap, 0, sizeof(*snap));
+	snap->head.type = FED_SNAPSHOT;
+	snap->head.from = partitionId;
+	snap->head.round = round;
+	for (int w = 0; w < waitQueueSize && snap->blockedCount < MAX_PROCESSES; w++) {
+		FedBlocked *b = &snap->blocked[snap->blockedCount++];
+		b->pid = waitQueue[w].pid;
+		b->enqueueNs = waitQueue[w].enqueueNs;
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			b->deficit[j] = waitQueue[w].counts[j] - available[j];
+		}
+	}
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		snap->slotPid[i] = processTable[i].pid;
+		memcpy(snap->held[i], allocation[i], sizeof(snap->held[i]));
+	}
+	fedStats.snapshots++;
+	fedStats.blockedReported += snap->blockedCount;
+}
+
+bool fedWasSuspect(const FedBlocked *b) {
+	for (int k = 0; k < fedSuspectCount; k++) {
+		if (fedSuspects[k].pid == b->pid && fedSuspects[k].enqueueNs == b->enqueueNs) return true;
+	}
+	return false;
+}
+
+//Primary, once every snapshot of the round is in: the reduction of detectAndResolveDeadlock over all
+//partitions. Workers not blocked anywhere can finish; a blocked worker can finish once the instances
+//held by finished workers cover its deficit in every partition.
+void fedResolveRound() {
+	stat_federation_rounds++;
+	FedBlocked *blocked[MAX_PARTITIONS * MAX_PROCESSES];
+	int blockedPartition[MAX_PARTITIONS * MAX_PROCESSES];
+	int blockedCount = 0;
+	for (int p = 0; p < federatedPartitions; p++) {
+		for (int b = 0; b < fedSnapshots[p].blockedCount; b++) {
+			blockedPartition[blockedCount] = p;
+			blocked[blockedCount++] = &fedSnapshots[p].blocked[b];
+		}
+	}
+
+	//A worker can finish if it is blocked nowhere (or already gone)
+	bool finish[MAX_PARTITIONS * MAX_PROCESSES] = {false};
+	bool finished[18];
+	for (int i = 0; i < 18; i++) {
+		finished[i] = true;
+		for (int b = 0; b < blockedCount; b++) {
+			if (processTable[i].pid != 0 && blocked[b]->pid == processTable[i].pid) finished[i] = false;
+		}
+	}
+
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (int b = 0; b < blockedCount; b++) {
+			if (finish[b]) continue;
+			int idx = findProcessIndex(blocked[b]->pid);
+			if (idx == -1 || finished[idx]) {
+				finish[b] = true;
+				continue;
+			}
+			//Instances of this partition's resources that finished workers give back
+			FedSnapshot *snap = &fedSnapshots[blockedPartition[b]];
+			bool canFinish = true;
+			for (int j = 0; j < NUM_RESOURCES && canFinish; j++) {
+				int missing = blocked[b]->deficit[j];
+				for (int s = 0; s < MAX_PROCESSES && missing > 0; s++) {
+					if (snap->slotPid[s] == 0 || snap->held[s][j] == 0) continue;
+					int holder = findProcessIndex(snap->slotPid[s]);
+					if (holder == -1 || finished[holder]) missing -= snap->held[s][j];
+				}
+				if (missing > 0) canFinish = false;
+			}
+			if (!canFinish) continue;
+			finish[b] = true;
+			//Every wait of this worker must be satisfiable before it can finish
+			bool allWaits = true;
+			for (int c = 0; c < blockedCount; c++) {
+				if (blocked[c]->pid == blocked[b]->pid && !finish[c]) allWaits = false;
+			}
+			if (allWaits) {
+				finished[idx] = true;
+				progress = true;
+			}
+		}
+	}
+
+	//Only a wait found deadlocked in two rounds in a row is treated as real
+	FedBlocked suspects[MAX_PROCESSES];
+	int suspectCount = 0;
+	int victim = -1;
+	for (int b = 0; b < blockedCount; b++) {
+		int idx = findProcessIndex(blocked[b]->pid);
+		if (idx == -1 || finished[idx] || suspectCount == MAX_PROCESSES) continue;
+		if (victim == -1 && fedWasSuspect(blocked[b])) victim = idx;
+		suspects[suspectCount++] = *blocked[b];
+	}
+	memcpy(fedSuspects, suspects, sizeof(FedBlocked) * suspectCount);
+	fedSuspectCount = suspectCount;
+
+	if (victim == -1) {
+		oss_log_verbose("OSS: Deadlock detection round %d: %d blocked, %d suspected, none confirmed\n",
+				fedRound, blockedCount, suspectCount);
+		return;
+	}
+	fedStats.deadlocksFound++;
+	oss_log("OSS: Deadlock across partitions confirmed at time %u:%u. Deadlocked processes:",
+			simClock->seconds, simClock->nanoseconds);
+	for (int k = 0; k < suspectCount; k++) {
+		oss_log(" P%d", findProcessIndex(suspects[k].pid));
+	}
+	oss_log("\n");
+	oss_log("OSS: Terminating process P%d (PID %d) to resolve deadlock\n", victim, processTable[victim].pid);
+	killDeadlockVictim(victim);
+	stat_federation_kills++;
+	fedSuspectCount = 0; //the others are re-checked against the next two rounds
+}
+
+//Primary: a snapshot for the current round arrived (or was taken locally)
+void fedCollect(const FedSnapshot *snap) {
+	int p = snap->head.from;
+	if (snap->head.round != fedRound || p < 0 || p >= federatedPartitions || fedHaveSnapshot[p]) return;
+	fedSnapshots[p] = *snap;
+	fedHaveSnapshot[p] = true;
+	for (int q = 0; q < federatedPartitions; q++) {
+		if (!fedHaveSnapshot[q]) return;
+	}
+	fedResolveRound();
+}
+
+//Primary, on the detection timer: start a round in every partition
+void federationDetect() {
+	for (int p = 0; p < federatedPartitions; p++) {
+		if (fedRound > 0 && !fedHaveSnapshot[p]) {
+			stat_federation_incomplete++;
+			break;
+		}
+	}
+	fedRound++;
+	memset(fedHaveSnapshot, 0, sizeof(fedHaveSnapshot));
+	FedMessage msg = {.type = FED_ROUND, .round = fedRound};
+	fedBroadcast(&msg);
+	FedSnapshot own;
+	fedTakeSnapshot(&own, fedRound);
+	fedCollect(&own);
+}
+
+//Partitions: drop workers that died without a GONE reaching us (a dropped datagram, or a request
+//that arrived after its sender was killed)
+void fedSweepDeadWorkers() {
+	for (int i = 0; i < MAX_PROCESSES; i++) {
+		if (processTable[i].pid != 0 && kill(processTable[i].pid, 0) == -1 && errno == ESRCH) {
+			releaseAllAndRemove(i);
+		}
+	}
+}
+
+//Handle everything pending on the mesh. True if there was anything.
+bool handleFederationMessages() {
+	bool heard = false;
+	FedSnapshot buf;
+	for (int q = 0; q < federatedPartitions; q++) {
+		if (q == partitionId) continue;
+		ssize_t n;
+		while ((n = recv(fedSock[partitionId][q], &buf, sizeof(buf), MSG_DONTWAIT)) >= (ssize_t)sizeof(FedMessage)) {
+			heard = true;
+			switch (buf.head.type) {
+				case FED_GONE: {
+					int idx = findProcessIndex(buf.head.pid);
+					if (idx != -1) releaseAllAndRemove(idx);
+					break;
+				}
+				case FED_ROUND: {
+					fedSweepDeadWorkers();
+					FedSnapshot snap;
+					fedTakeSnapshot(&snap, buf.head.round);
+					fedSend(0, &snap, sizeof(snap));
+					break;
+				}
+				case FED_SNAPSHOT:
+					if (partitionId == 0 && n == sizeof(FedSnapshot)) fedCollect(&buf);
+					break;
+			}
+		}
+	}
+	return heard;
+}
+
+//One readiness check over the signalfd, the control FIFO and the partition sockets, so each is read
+//only when it has something. The SysV message queue can't be polled and is drained separately.
+void pollEventSources() {
+	struct pollfd fds[2 + MAX_PARTITIONS];
+	int count = 0;
+	fds[count++] = (struct pollfd){sigfd, POLLIN, 0};
+	int controlIndex = -1;
+	if (controlFd != -1) {
+		controlIndex = count;
+		fds[count++] = (struct pollfd){controlFd, POLLIN, 0};
+	}
+	int fedFirst = count;
+	for (int q = 0; q < federatedPartitions; q++) {
+		if (q != partitionId) fds[count++] = (struct pollfd){fedSock[partitionId][q], POLLIN, 0};
+	}
+	stat_event_polls++;
+	if (poll(fds, count, 0) <= 0) return;
+
+	if (fds[0].revents & POLLIN) {
+		handleSignalEvents();
+	}
+	if (controlIndex != -1 && (fds[controlIndex].revents & POLLIN)) {
+		handleControlCommands();
+	}
+	for (int k = fedFirst; k < count; k++) {
+		if (fds[k].revents & POLLIN) {
+			handleFederationMessages();
+			break;
+		}
+	}
+}
+
+//Partitions learn of a worker from its first request, and take its claim on their resources from the
+//claim the primary accepted and published. A worker always declares its claim before it requests.
+void fedAdoptSenders(struct oss_message *batch, int count) {
+	for (int m = 0; m < count; m++) {
+		if (batch[m].command != REQUEST_RESOURCE && batch[m].command != REQUEST_VECTOR) continue;
+		if (findProcessIndex(batch[m].pid) != -1 || kill(batch[m].pid, 0) == -1) continue;
+		const PublishedClaim *published = NULL;
+		for (int k = 0; k < PROCESS_SLOTS; k++) {
+			if (sharedState->federation.claims[k].pid == batch[m].pid) published = &sharedState->federation.claims[k];
+		}
+		if (published == NULL) continue; //no accepted claim, so the request is refused as from an unknown worker
+		int slot = findProcessIndex(0);
+		if (slot == -1) {
+			fedSweepDeadWorkers();
+			slot = findProcessIndex(0);
+			if (slot == -1) continue;
+		}
+		setSlotPid(slot, batch[m].pid);
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			setMaxClaim(slot, j, sharedState->federation.owner[j] == partitionId ? published->claim[j] : 0);
+		}
+		fedStats.adopted++;
+	}
+}
+
+//A partition only has instances of the resources it owns
+void keepOwnedResources() {
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (sharedState->federation.owner[j] == partitionId) continue;
+		setAvailable(j, 0);
+		resourceTable[j].totalInstances = 0;
+	}
+}
+
+//Publish this partition's counters for the primary's report
+void publishPartitionStats() {
+	fedStats.grants = stat_requests_granted_immediately + stat_requests_granted_after_wait;
+	fedStats.grantsAfterWait = stat_requests_granted_after_wait;
+	fedStats.cpu = ossCpu;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		if (sharedState->federation.owner[j] != partitionId) continue;
+		fedStats.requests += resourceProfile[j].requests;
+		fedStats.waits += resourceProfile[j].waitsUnavailable + resourceProfile[j].waitsUnsafe;
+	}
+	sharedState->federation.stats[partitionId] = fedStats;
+}
 
-	//Print header
-	offset += snprintf(buffer + offset, sizeof(buffer) - offset, 
-					  "Current process allocations:\n  ");
+//Body of a forked partition: serve requests for our resources until the primary stops us. Never
+//returns, and leaves the IPC objects to the primary.
+void runPartition(int p) {
+	partitionId = p;
+	msqid = sharedState->federation.msqid[p];
+	for (int a = 0; a < federatedPartitions; a++) {
+		for (int b = 0; b < federatedPartitions; b++) {
+			if (a != b && a != p) close(fedSock[a][b]);
+		}
+	}
+	if (controlFd != -1) close(controlFd);
+	placePartition(p);
+	keepOwnedResources();
+	oss_log_verbose("OSS: Partition %d (pid %d) serving on message queue %d\n", p, getpid(), msqid);
 
-	//Print resource IDs header
-	for (int i = 0; i < NUM_RESOURCES && offset < sizeof(buffer); i++) {
-		offset += snprintf(buffer + offset, sizeof(buffer) - offset, "R%-2d ", i);
+	bool stopping = false;
+	while (!stopping) {
+		int batchSize = drainMessages(messageBatch, MAX_MESSAGE_BATCH);
+		if (batchSize > 0) {
+			fedAdoptSenders(messageBatch, batchSize);
+			processMessageBatch(messageBatch, batchSize);
+		}
+		if (outboxCount > 0) {
+			flushOutbox();
+		}
+		bool heard = handleFederationMessages();
+		if (waitQueueDirty) {
+			processWaitQueue();
+		}
+
+		struct signalfd_siginfo info;
+		while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+			if (info.ssi_signo != SIGCHLD) stopping = true;
+		}
+		if (batchSize == 0 && !heard && outboxCount == 0) {
+			usleep(50);
+		}
 	}
-	offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n");
+	publishPartitionStats();
+	_exit(0); //the primary owns the shared segment and queues
+}
 
-	//Print process allocations
-	for (int i = 0; i < 18 && offset < sizeof(buffer); i++) {
-		if (processTable[i].pid != 0) {
-			offset += snprintf(buffer + offset, sizeof(buffer) - offset, "P%-2d ", i);
-			
-			for (int j = 0; j < NUM_RESOURCES && offset < sizeof(buffer); j++) {
-				// Validate allocation value
-				int alloc = allocation[i][j];
-				if (alloc < 0) alloc = 0;
-				if (alloc > NUM_INSTANCES) alloc = NUM_INSTANCES;
-				
-				offset += snprintf(buffer + offset, sizeof(buffer) - offset, "%2d  ", alloc);
+//Primary: create the partitions' queues and sockets and fork them, before any worker exists
+bool setupFederation() {
+	FederationState *fed = &sharedState->federation;
+	fed->partitions = federatedPartitions;
+	fed->msqid[0] = msqid;
+	for (int p = 1; p < MAX_PARTITIONS; p++) {
+		fed->msqid[p] = -1;
+	}
+	for (int p = 0; p < MAX_PARTITIONS; p++) {
+		fed->stats[p].cpu = -1; //until the partition publishes its own
+	}
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		fed->owner[j] = j % federatedPartitions;
+	}
+	for (int p = 1; p < federatedPartitions; p++) {
+		fed->msqid[p] = msgget(IPC_PRIVATE, IPC_CREAT | IPC_EXCL | 0600);
+		if (fed->msqid[p] == -1) {
+			perror("msgget partition");
+			return false;
+		}
+	}
+	for (int a = 0; a < federatedPartitions; a++) {
+		for (int b = a + 1; b < federatedPartitions; b++) {
+			int sv[2];
+			if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv) == -1) {
+				perror("socketpair");
+				return false;
 			}
-			offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n");
+			fedSock[a][b] = sv[0];
+			fedSock[b][a] = sv[1];
 		}
 	}
 
-	//Write the complete buffer to log
-	if (logfile) fprintf(logfile, "%s", buffer);
-	printf("%s", buffer);
+	fflush(NULL); //don't let the children inherit unwritten output
+	for (int p = 1; p < federatedPartitions; p++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			runPartition(p);
+		}
+		if (pid < 0) {
+			perror("fork partition");
+			return false;
+		}
+		partitionPids[p] = pid;
+	}
+	for (int a = 1; a < federatedPartitions; a++) {
+		for (int b = 0; b < federatedPartitions; b++) {
+			if (a != b) close(fedSock[a][b]);
+		}
+	}
+	keepOwnedResources();
+	oss_log("OSS: Resources federated over %d partitions\n", federatedPartitions);
+	return true;
 }
 
-// Helper to print statistics
-void printStatistics() {
-	char buffer[512] = {0};
-	int offset = 0;
-
-	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-		"\n==== Simulation Statistics ====\n"
-		"Requests granted immediately: %d\n"
-		"Requests granted after waiting: %d\n"
-		"Processes terminated by deadlock: %d\n"
-		"Processes terminated normally: %d\n"
-		"Deadlock detection runs: %d\n"
-		"Processes terminated per deadlock event: %d\n"
-		"===============================\n\n",
-		stat_requests_granted_immediately,
-		stat_requests_granted_after_wait,
-		stat_deadlock_terminations,
-		stat_normal_terminations,
-		stat_deadlock_detection_runs,
-		stat_deadlock_processes_terminated);
-
-	// Write the complete buffer to log
-	if (logfile) fprintf(logfile, "%s", buffer);
-	printf("%s", buffer);
+void stopPartitions() {
+	if (partitionsStopping) return;
+	partitionsStopping = true;
+	for (int p = 1; p < federatedPartitions; p++) {
+		if (partitionPids[p] > 0) kill(partitionPids[p], SIGTERM);
+	}
 }
 
-// SIGINT handler for cleanup on Ctrl+C
-void handle_sigint(int sig) {
-	//Send SIGTERM to all children
-	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid != 0) {
-			kill(processTable[i].pid, SIGTERM);
+//True if pid was one of our partitions. Losing one mid-run strands its workers, so the run ends.
+bool accountPartitionExit(pid_t pid, int status, bool shuttingDown) {
+	for (int p = 1; p < federatedPartitions; p++) {
+		if (partitionPids[p] != pid) continue;
+		partitionPids[p] = 0;
+		if (!partitionsStopping) {
+			oss_log("OSS: Partition %d (pid %d) exited unexpectedly (status %d), ending the simulation\n", p, pid, status);
+			simulationOver = true;
 		}
+		return true;
 	}
+	return false;
+}
 
-	//Give them a moment to exit
-	usleep(200000); //200ms
+void printFederationReport() {
+	char buffer[2048] = {0};
+	int offset = 0;
+	FederationState *fed = &sharedState->federation;
 
-	//Send SIGTERM to any that remain
-	for (int i = 0; i < 18; i++) {
-		if (processTable[i].pid != 0) {
-			kill(processTable[i].pid, SIGTERM);
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+		"==== Partitions ====\n"
+		"Part  CPU  Resources      Reqs  Grants (after wait)  Waits  Adopted  Snapshots  Blocked reported\n");
+	for (int p = 0; p < federatedPartitions && offset < sizeof(buffer); p++) {
+		char owned[64] = "";
+		int len = 0;
+		for (int j = 0; j < NUM_RESOURCES; j++) {
+			if (fed->owner[j] == p) len += snprintf(owned + len, sizeof(owned) - len, "%sR%d", len ? "," : "", j);
 		}
+		PartitionStats *st = &fed->stats[p];
+		char cpu[16] = "any";
+		if (st->cpu != -1) snprintf(cpu, sizeof(cpu), "%d", st->cpu);
+		offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+			"P%-3d  %-3s  %-12s  %5d  %6d (%5d)       %5d  %7d  %9d  %16d\n",
+			p, cpu, owned, st->requests, st->grants, st->grantsAfterWait, st->waits, st->adopted,
+			st->snapshots, st->blockedReported);
 	}
+	offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+		"Detection rounds: %d complete, %d incomplete; deadlocks confirmed: %d\n"
+		"====================\n\n", stat_federation_rounds, stat_federation_incomplete, fed->stats[0].deadlocksFound);
 
-	//Wait for all children
-	while (wait(NULL) > 0);
-	//Cleanup shared memory
-	cleanup_shared_memory();
-	//Print final statistics
-    	if (logfile) fclose(logfile);
-    	exit(0);
+	if (logfile) fprintf(logfile, "%s", buffer);
+	printf("%s", buffer);
 }
 
-
-// Add launch interval to global variables
-int launch_interval_ms = DEFAULT_LAUNCH_INTERVAL_MS;
-unsigned int last_launch_time_ns = 0;
-unsigned int last_launch_time_s = 0;
-
-//Add to global variables
-unsigned int last_deadlock_check_s = 0;
-
 int main(int argc, char *argv[]) {
-	//Register SIGINT handler for cleanup
-	signal(SIGINT, sigint_handler);
+	//SIGINT, SIGTERM, SIGHUP and SIGCHLD are handled through a signalfd in the main loop
+	setup_signal_fd();
+	runId = (unsigned int)getpid();
+	clock_gettime(CLOCK_MONOTONIC, &run_start_wall);
 
-	//Initialize process tracking
-	int totalProcesses = 0;
-	int runningChildren = 0;
-	struct oss_message oss_msg;
 
 	//Command line argument parsing 
 	char *logfilename = NULL;
 	int opt;
-	while ((opt = getopt(argc, argv, "hi:n:s:f:v")) != -1) {
+	while ((opt = getopt(argc, argv, "hi:n:s:f:o:r:H:Q:p:d:T:R:C:w:L:K:k:A:P:c:t:F:X:DZ:v")) != -1) {
 		switch (opt) {
 			case 'h':
-				printf("Usage: %s [-h] [-n proc] [-s simul] [-i intervalInMsToLaunchChildren] [-f logfile] [-v]\n", argv[0]);
+				printf("Usage: %s [-h] [-n proc] [-s simul] [-i intervalInMsToLaunchChildren] [-f logfile] [-o statsfile] [-r runId] [-H minHeadroom] [-Q maxBlocked] [-p policy] [-d strategy] [-T pct] [-R recovery] [-C cache] [-w workload] [-L leaseSize] [-K file@ms] [-k file] [-A cpu] [-P placement[:cpus]] [-c controlFifo] [-t pacing] [-F partitions] [-X kernel] [-D] [-Z runs[:seed]|replay] [-v]\n", argv[0]);
 				printf("Options:\n");
 				printf("  -h  Show this help message\n");
-				printf("  -n  Maximum number of processes to create\n");
-				printf("  -s  Maximum simulation time in seconds\n");
+				printf("  -n  Total number of processes to create (at most %d at once)\n", MAX_PROCESSES);
+				printf("  -s  Maximum simulation time in simulated seconds (default: 5)\n");
 				printf("  -i  Interval in milliseconds between launching children\n");
 				printf("  -f  Log file name\n");
+				printf("  -o  Write final statistics as JSON to this file\n");
+				printf("  -r  Run ID used to tag this run's IPC objects (default: oss pid)\n");
+				printf("  -H  Delay launches while banker's headroom (available - outstanding claims) is below this\n");
+				printf("  -Q  Delay launches while this many requests are blocked (default: %d)\n", DEFAULT_ADMISSION_MAX_WAIT);
+				printf("  -p  Wait queue policy: fifo, snf (shortest need), mhf (most held), aging (default: fifo)\n");
+				printf("  -d  Deadlock strategy: avoid (banker's), detect (optimistic + recovery), hybrid (default: avoid)\n");
+				printf("  -T  Hybrid: %% of all instances allocated before banker's checks start (default: %d)\n", DEFAULT_HYBRID_THRESHOLD);
+				printf("  -R  Deadlock recovery: kill (terminate a victim) or preempt (revoke instances) (default: kill)\n");
+				printf("  -C  Safety verdict cache: off, on or verify (recompute and compare every hit) (default: on)\n");
+				printf("  -w  Worker workload profile: a file, or inline key=value,... (see README)\n");
+				printf("  -L  Lease up to this many instances per resource to each worker while nothing is blocked (default: 0, off)\n");
+				printf("  -K  Write a checkpoint to file once simulated time reaches ms (e.g. -K warm.ckpt@2000)\n");
+				printf("  -k  Start from a checkpoint, re-spawning a worker for every live process in it\n");
+				printf("  -A  Pin oss to this CPU\n");
+				printf("  -P  Worker placement: none, compact, spread or exclude (all but oss's CPU), optionally :cpus like spread:0-7 (default: none)\n");
+				printf("  -c  Accept runtime commands on this FIFO (created if missing, see README)\n");
+				printf("  -t  Worker pacing: wall (sleep in real time), sim (sleep in simulated time) or ff (sim, skipping idle time) (default: wall)\n");
+				printf("  -F  Split the resources over this many oss partitions, 2-%d (implies -d detect -R kill)\n", MAX_PARTITIONS);
+				printf("  -X  Safety kernel: auto (unrolled for this shape if built in), packed or generic (default: auto)\n");
+				printf("  -D  Check every allocator event and decision against a reference oracle (see README)\n");
+				printf("  -Z  Fuzz the allocator against the oracle for this many runs and exit, or re-run a replay file\n");
 				printf("  -v  Verbose output mode\n");
 				exit(0);
 			case 'n':
 				maxProcesses = atoi(optarg);
+				if (maxProcesses <= 0) {
+					fprintf(stderr, "Number of processes must be positive\n");
+					exit(1);
+				}
 				break;
 			case 's':
 				maxRuntimeSeconds = atoi(optarg);
+				if (maxRuntimeSeconds <= 0) {
+					fprintf(stderr, "Simulation time must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'c':
+				controlPath = optarg;
+				break;
+			case 't': {
+				int found = -1;
+				for (int k = 0; k < (int)(sizeof(pacingNames) / sizeof(pacingNames[0])); k++) {
+					if (strcmp(optarg, pacingNames[k]) == 0) found = k;
+				}
+				if (found == -1) {
+					fprintf(stderr, "Unknown pacing '%s'\n", optarg);
+					exit(1);
+				}
+				pacingMode = found;
+				break;
+			}
+			case 'F':
+				federatedPartitions = atoi(optarg);
+				if (federatedPartitions < 2 || federatedPartitions > MAX_PARTITIONS) {
+					fprintf(stderr, "Partitions must be between 2 and %d\n", MAX_PARTITIONS);
+					exit(1);
+				}
 				break;
 			case 'i':
 				launchIntervalMs = atoi(optarg);
@@ -671,11 +4866,150 @@ int main(int argc, char *argv[]) {
 					exit(1);
 				}
 				break;
+			case 'o':
+				statsfilename = optarg;
+				break;
+			case 'r':
+				runId = (unsigned int)strtoul(optarg, NULL, 10);
+				break;
+			case 'H': {
+				//Headroom runs from every instance free and unclaimed down to every slot claiming everything
+				char *end;
+				long value = strtol(optarg, &end, 10);
+				if (end == optarg || *end != '\0' || value > NUM_RESOURCES * NUM_INSTANCES ||
+						value < -(long)MAX_PROCESSES * NUM_RESOURCES * NUM_INSTANCES) {
+					fprintf(stderr, "Minimum headroom must be between %d and %d\n",
+							-MAX_PROCESSES * NUM_RESOURCES * NUM_INSTANCES, NUM_RESOURCES * NUM_INSTANCES);
+					exit(1);
+				}
+				admissionMinHeadroom = (int)value;
+				break;
+			}
+			case 'Q':
+				admissionMaxWait = atoi(optarg);
+				if (admissionMaxWait < 1 || admissionMaxWait > MAX_WAIT_QUEUE) {
+					fprintf(stderr, "Blocked request limit must be between 1 and %d\n", MAX_WAIT_QUEUE);
+					exit(1);
+				}
+				break;
+			case 'p': {
+				int found = -1;
+				for (int k = 0; k < (int)(sizeof(policyNames) / sizeof(policyNames[0])); k++) {
+					if (strcmp(optarg, policyNames[k]) == 0) found = k;
+				}
+				if (found == -1) {
+					fprintf(stderr, "Unknown wait queue policy '%s'\n", optarg);
+					exit(1);
+				}
+				waitPolicy = found;
+				break;
+			}
+			case 'd': {
+				int found = -1;
+				for (int k = 0; k < (int)(sizeof(strategyNames) / sizeof(strategyNames[0])); k++) {
+					if (strcmp(optarg, strategyNames[k]) == 0) found = k;
+				}
+				if (found == -1) {
+					fprintf(stderr, "Unknown deadlock strategy '%s'\n", optarg);
+					exit(1);
+				}
+				deadlockStrategy = found;
+				break;
+			}
+			case 'T':
+				hybridThresholdPct = atoi(optarg);
+				break;
+			case 'R':
+				if (strcmp(optarg, "kill") == 0) {
+					recoveryMode = RECOVERY_KILL;
+				} else if (strcmp(optarg, "preempt") == 0) {
+					recoveryMode = RECOVERY_PREEMPT;
+				} else {
+					fprintf(stderr, "Unknown recovery mode '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'w':
+				workloadProfile = optarg;
+				break;
+			case 'L':
+				leaseSize = atoi(optarg);
+				if (leaseSize < 0 || leaseSize > NUM_INSTANCES) {
+					fprintf(stderr, "Lease size must be between 0 and %d\n", NUM_INSTANCES);
+					exit(1);
+				}
+				break;
+			case 'K': {
+				char *at = strrchr(optarg, '@');
+				if (at == NULL || at == optarg || atoll(at + 1) <= 0) {
+					fprintf(stderr, "Checkpoint must be given as file@ms\n");
+					exit(1);
+				}
+				*at = '\0';
+				checkpointFile = optarg;
+				checkpointAtMs = atoll(at + 1);
+				break;
+			}
+			case 'k':
+				restoreFile = optarg;
+				break;
+			case 'A':
+				ossCpu = atoi(optarg);
+				if (ossCpu < 0 || ossCpu >= CPU_SETSIZE) {
+					fprintf(stderr, "CPU must be between 0 and %d\n", CPU_SETSIZE - 1);
+					exit(1);
+				}
+				break;
+			case 'P': {
+				char *cpus = strchr(optarg, ':');
+				if (cpus) *cpus++ = '\0';
+				int found = -1;
+				for (int k = 0; k < (int)(sizeof(placementNames) / sizeof(placementNames[0])); k++) {
+					if (strcmp(optarg, placementNames[k]) == 0) found = k;
+				}
+				if (found == -1) {
+					fprintf(stderr, "Unknown worker placement '%s'\n", optarg);
+					exit(1);
+				}
+				workerPlacement = found;
+				placementCpuSpec = cpus;
+				break;
+			}
+			case 'C': {
+				int found = -1;
+				for (int k = 0; k < 3; k++) {
+					if (strcmp(optarg, cacheModeNames[k]) == 0) found = k;
+				}
+				if (found == -1) {
+					fprintf(stderr, "Unknown cache mode '%s'\n", optarg);
+					exit(1);
+				}
+				cacheMode = found;
+				break;
+			}
+			case 'X': {
+				int found = -1;
+				for (int k = 0; k < 3; k++) {
+					if (strcmp(optarg, kernelModeNames[k]) == 0) found = k;
+				}
+				if (found == -1) {
+					fprintf(stderr, "Unknown safety kernel '%s'\n", optarg);
+					exit(1);
+				}
+				kernelMode = found;
+				break;
+			}
+			case 'D':
+				oracleMode = true;
+				break;
+			case 'Z':
+				fuzzSpec = optarg;
+				break;
 			case 'v':
 				verbose = 1;
 				break;
 			default:
-				fprintf(stderr, "Usage: %s [-h] [-n proc] [-s simul] [-i intervalInMsToLaunchChildren] [-f logfile] [-v]\n", argv[0]);
+				fprintf(stderr, "Usage: %s [-h] [-n proc] [-s simul] [-i intervalInMsToLaunchChildren] [-f logfile] [-o statsfile] [-r runId] [-H minHeadroom] [-Q maxBlocked] [-p policy] [-d strategy] [-T pct] [-R recovery] [-C cache] [-w workload] [-L leaseSize] [-K file@ms] [-k file] [-A cpu] [-P placement[:cpus]] [-c controlFifo] [-t pacing] [-F partitions] [-X kernel] [-D] [-Z runs[:seed]|replay] [-v]\n", argv[0]);
 				exit(1);
 		}
 	}
@@ -689,43 +5023,51 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	//Federated partitions only detect deadlock and recover by killing, and can't share leases, snapshots or fast-forward
+	if (federatedPartitions > 0) {
+		if (leaseSize > 0 || checkpointFile || restoreFile || pacingMode == PACING_FAST_FORWARD) {
+			fprintf(stderr, "-F can't be combined with -L, -K, -k or -t ff\n");
+			exit(1);
+		}
+		if (deadlockStrategy != STRATEGY_DETECT || recoveryMode != RECOVERY_KILL) {
+			oss_log("OSS: Federated run, using detect with kill recovery\n");
+			deadlockStrategy = STRATEGY_DETECT;
+			recoveryMode = RECOVERY_KILL;
+		}
+	}
+
+	//The oracle and the fuzzer need the whole allocator state in one process
+	if ((oracleMode || fuzzSpec) && federatedPartitions > 0) {
+		fprintf(stderr, "-D and -Z can't be combined with -F\n");
+		exit(1);
+	}
+	if (fuzzSpec && restoreFile) {
+		fprintf(stderr, "-Z starts from empty tables and can't be combined with -k\n");
+		exit(1);
+	}
+
+	//Pin oss and work out where workers go before anything is forked
+	setupPlacement();
+
 	// Shared memory setup 
 	if (setup_shared_memory()) {
-		fprintf(stderr, "Failed to setup shared memory for clock\\n");
+		fprintf(stderr, "Failed to setup shared memory for clock\n");
 		return 1;
 	}
+	atexit(cleanup_shared_memory);
+
+	if (controlPath) {
+		setupControlChannel();
+	}
 
 	// Message queue setup
-	msqid = msgget(MSGKEY, IPC_CREAT | 0666);
-	if (msqid == -1) {
-		perror("msgget");
-		cleanup_shared_memory();
+	if (setup_message_queue()) {
 		exit(1);
 	}
+	oss_log_verbose("OSS: Run %u using shm %d and message queue %d\n", runId, shmid, msqid);
 
-	//Clear OSS arrays
-	memset(resourceTable, 0, sizeof(ResourceDescriptor) * NUM_RESOURCES);
-	memset(available, 0, sizeof(int) * NUM_RESOURCES);
-	memset(allocation, 0, sizeof(int) * 18 * NUM_RESOURCES);
-	memset(max, 0, sizeof(int) * 18 * NUM_RESOURCES);
-	memset(need, 0, sizeof(int) * 18 * NUM_RESOURCES);
-	memset(processTable, 0, sizeof(PCB) * 18);
-
-	// Initialize resources with explicit bounds checking
-	for (int i = 0; i < NUM_RESOURCES; i++) {
-		if (i >= 0 && i < NUM_RESOURCES) {  // Extra validation
-			resourceTable[i].totalInstances = NUM_INSTANCES;
-			resourceTable[i].availableInstances = NUM_INSTANCES;
-			available[i] = NUM_INSTANCES;
-			
-			for (int j = 0; j < 18; j++) {
-				resourceTable[i].allocated[j] = 0;
-				allocation[j][i] = 0;
-				max[j][i] = NUM_INSTANCES / 2;  // Maximum demand is half of total
-				need[j][i] = max[j][i];
-			}
-		}
-	}
+	initAllocatorTables();
+	selectSafetyKernel();
 
 	//Verify initialization
 	for (int i = 0; i < NUM_RESOURCES; i++) {
@@ -738,216 +5080,75 @@ int main(int argc, char *argv[]) {
 	}
 
 
-	//printf("sizeof(struct oss_message) = %zu\n", sizeof(struct oss_message));
-	//printf("sizeof(struct worker_message) = %zu\n", sizeof(struct worker_message));
-
-	while (1) {
-		//a. Increment the clock
-		simClock->nanoseconds += 1000000; //increment by 1ms
-		if (simClock->nanoseconds >= 1000000000) {
-			simClock->seconds++;
-			simClock->nanoseconds -= 1000000000;
-		}
-
-		//Check if it's time to launch a new process
-		unsigned int elapsed_ns = (simClock->seconds - last_launch_time_s) * 1000000000 + 
-								(simClock->nanoseconds - last_launch_time_ns);
-		
-		if (elapsed_ns >= (launch_interval_ms * 1000000)) {  // Convert ms to ns
-			//Update running children count
-			runningChildren = 0;
-			for (int i = 0; i < MAX_PROCESSES; i++) {
-				if (processTable[i].pid != 0) runningChildren++;
-			}
-
-			if (runningChildren < MAX_PROCESSES && totalProcesses < MAX_PROCESSES) {
-				pid_t pid = fork();
-				if (pid == 0) {
-					//Child process
-					char bound_B_str[20];
-					sprintf(bound_B_str, "%d", 100000);
-					execl("./user_proc", "user_proc", bound_B_str, NULL);
-					perror("execl");
-					exit(1);
-				} else if (pid > 0) {
-					//Parent process
-					int slot = -1;
-					for (int i = 0; i < MAX_PROCESSES; i++) {
-						if (processTable[i].pid == 0) {
-							slot = i;
-							break;
-						}
-					}
-					if (slot != -1) {
-						processTable[slot].pid = pid;
-						oss_log_verbose("OSS: Launched child process %d in slot %d\n", pid, slot);
-						totalProcesses++;
-						last_launch_time_s = simClock->seconds;
-						last_launch_time_ns = simClock->nanoseconds;
-					}
-				}
-			}
-		}
-
-		//b. Check for messages from user processes
-		if (msgrcv(msqid, &oss_msg, sizeof(struct oss_message) - sizeof(long), 0, IPC_NOWAIT) == -1) {
-			if (errno != ENOMSG) {  // Only show error if it's not "no message"
-				perror("msgrcv");
-			}
-			continue;  // Skip this iteration if no message
-		}
+	if (fuzzSpec) {
+		exit(runFuzzer(fuzzSpec));
+	}
 
-		// Validate message before processing
-		if (oss_msg.command != REQUEST_RESOURCE && 
-			oss_msg.command != RELEASE_RESOURCE && 
-			oss_msg.command != TERMINATE) {
-			// Instead of warning, just skip invalid messages silently
-			continue;
-		}
+	//Resume from a checkpoint once the fresh tables check out
+	if (restoreFile && !restoreCheckpoint(restoreFile)) {
+		return 1;
+	}
+	if (oracleMode) {
+		oracleStart(); //after a restore, whose state it takes as given
+	}
 
-		if (oss_msg.resourceId < 0 || oss_msg.resourceId >= NUM_RESOURCES) {
-			// Instead of warning, just skip invalid resource IDs silently
-			continue;
-		}
+	//Partitions are forked from the fresh tables, before the first worker
+	if (federatedPartitions > 0 && !setupFederation()) {
+		return 1;
+	}
 
+	//printf("sizeof(struct oss_message) = %zu\n", sizeof(struct oss_message));
+	//printf("sizeof(struct worker_message) = %zu\n", sizeof(struct worker_message));
 
-		// Message received
-		switch (oss_msg.command) {
-			case REQUEST_RESOURCE: {
-				// Find process index
-				int processIndex = -1;
-				for (int i = 0; i < 18; i++) {
-					if (processTable[i].pid == oss_msg.mtype) {
-						processIndex = i;
-						break;
-					}
-				}
+	setupTimers();
 
-				if (processIndex == -1) {
-					fprintf(stderr, "OSS Warning: Request from unknown process %ld\n", oss_msg.mtype);
-					continue;
-				}
+	int busyPasses = 0; //iterations since the last event poll that all had messages
 
-				// Check if request is valid
-				if (allocation[processIndex][oss_msg.resourceId] >= NUM_INSTANCES) {
-					fprintf(stderr, "OSS Warning: Process %ld requesting too many instances of R%d\n",
-							oss_msg.mtype, oss_msg.resourceId);
-					send_message_to_worker(oss_msg.mtype, 0);
-					continue;
-				}
-	
-				//Try to grant the request
-				int granted = handleResourceRequest(oss_msg.mtype, oss_msg.resourceId);
-				if (granted == 1) {
-					oss_log_verbose("OSS: Granted resource R%d to process %ld\n",
-						oss_msg.resourceId, oss_msg.mtype);
-					send_message_to_worker(oss_msg.mtype, 1);
-					stat_requests_granted_immediately++;
-				} else {
-					oss_log_verbose("OSS: Resource R%d not available for process %ld\n",
-						oss_msg.resourceId, oss_msg.mtype);
-					addToWaitQueue(oss_msg.mtype, oss_msg.resourceId);
-					send_message_to_worker(oss_msg.mtype, 0);
-				}
-				break;
-			}
-			case RELEASE_RESOURCE: {
-				int processIndex = -1;
-				for (int i = 0; i < 18; i++) {
-					if (processTable[i].pid == oss_msg.mtype) {
-						processIndex = i;
-						break;
-					}
-				}
-				if (processIndex != -1 && allocation[processIndex][oss_msg.resourceId] > 0) {
-					available[oss_msg.resourceId]++;
-					allocation[processIndex][oss_msg.resourceId]--;
-					need[processIndex][oss_msg.resourceId]++;
-					oss_log_verbose("OSS: Process %ld released resource %d\n", oss_msg.mtype, oss_msg.resourceId);
-				}
-				processWaitQueue(); //try to grant blocked requests after a release
-				break;
-			}
-			case TERMINATE: {
-				int processIndex = -1;
-				for (int i = 0; i < 18; i++) {
-					if (processTable[i].pid == oss_msg.mtype) {
-						processIndex = i;
-						break;
-					}
-				}
-				if (processIndex != -1) {
-					for (int j = 0; j < NUM_RESOURCES; j++) {
-						available[j] += allocation[processIndex][j];
-						allocation[processIndex][j] = 0;
-						need[processIndex][j] = max[processIndex][j];
-					}
-					processTable[processIndex].pid = 0;
-				}
-				send_message_to_worker(oss_msg.mtype, 1); // Send confirmation so user_proc can exit
-				stat_normal_terminations++;
-				break;
-			}
-			default: 
-				oss_log("OSS: Unknown message command %d from process %ld\n",
-					oss_msg.command, oss_msg.mtype);
+	while (1) {
+		//a. Increment the clock
+		advanceSimClock(1000000); //increment by 1ms
+		if (pacingMode != PACING_WALL) {
+			wakeDueSleepers();
 		}
 
-		//d. Check for terminated child processes
-		pid_t childPid;
-		int status;
-		while((childPid = waitpid(-1, &status, WNOHANG)) > 0) {
-			oss_log("OSS: Child process %d terminated\n", childPid);
-			stat_normal_terminations++;
-			//terminatedChildren++;
+		//Launches, detection and periodic output are timers; fire whatever is due
+		int fires = stat_timer_fires;
+		advanceTimerWheel();
 
-			//Clean up process table entry (if needed)
-			for (int i = 0; i < 18; i++) {
-				if (processTable[i].pid == childPid) {
-					processTable[i].pid = 0; //Or mark as not occupied
-					break;
-				}
-			}
+		//Retry replies that didn't fit in the queue last time
+		if (outboxCount > 0) {
+			flushOutbox();
 		}
 
-		//Move runningChildren counting here
-		int runningChildren = 0;
-		for (int i = 0; i < 18; i++) {
-			if (processTable[i].pid != 0) runningChildren++;
+		//b. Drain every pending message and handle them as one batch
+		int batchSize = drainMessages(messageBatch, MAX_MESSAGE_BATCH);
+		if (batchSize > 0) {
+			processMessageBatch(messageBatch, batchSize);
 		}
 
-		// Deadlock detection (every second)
-		if (simClock->seconds > last_deadlock_check_s) {
-			last_deadlock_check_s = simClock->seconds;
-			if (verbose) {
-				printf("OSS: Running deadlock detection at time %u:%u\n", 
-					   simClock->seconds, simClock->nanoseconds);
-			}
-			detectAndResolveDeadlock();
+		//d. Reap children and handle shutdown signals, runtime commands from the control FIFO and
+		//detection snapshots from the other partitions, each only when poll says it has something.
+		//While requests keep arriving that waits for a pass where a timer fired, or at most
+		//POLL_BUSY_INTERVAL passes, so a busy loop doesn't pay a syscall for every batch.
+		if (batchSize == 0 || stat_timer_fires != fires || ++busyPasses >= POLL_BUSY_INTERVAL) {
+			pollEventSources();
+			busyPasses = 0;
+		} else {
+			stat_event_polls_skipped++;
 		}
 
-		//Resource table output (every half second)
-		if ((simClock->nanoseconds % 500000000) == 0) {
-			if (verbose) {
-				printResourceTable();
-				printProcessTable();
-			}
+		//At the end of each loop, try to process the wait queue if capacity came back
+		if (waitQueueDirty) {
+			processWaitQueue();
 		}
-		
-		//At the end of each loop, try to process the wait queue
-		processWaitQueue();
-
 
-		//print resource and process tables every 20 grants
-		if ((stat_requests_granted_immediately + stat_requests_granted_after_wait) % 20 == 0) {
-    			printResourceTable();
-    			printProcessTable();
-    			printStatistics();
-    			//last_printed_request_count = stat_requests_granted_immediately + stat_requests_granted_after_wait;
+		//Skip simulated time nobody can use
+		if (pacingMode == PACING_FAST_FORWARD && batchSize == 0 && outboxCount == 0 && !waitQueueDirty) {
+			fastForward();
 		}
 
 		// Terminate if all children have finished or simulation time is up
-		if ((totalProcesses >= MAX_PROCESSES && runningChildren == 0) || simClock->seconds >= 5) {
+		if ((totalProcesses + stat_admission_rejects >= maxProcesses && countRunningChildren() == 0) || simulationOver) {
 			oss_log("OSS: Simulation terminating at time %u:%u\n", simClock->seconds, simClock->nanoseconds);
 			break;
 		}
@@ -962,20 +5163,31 @@ int main(int argc, char *argv[]) {
 			kill(processTable[i].pid, SIGTERM);
 		}
 	}
+	stopPartitions();
 	
 	//Wait for all children to exit
-	while (wait(NULL) > 0);
+	pid_t childPid;
+	int status;
+	while ((childPid = waitpid(-1, &status, 0)) > 0) {
+		accountChildExit(childPid, status, true);
+	}
 
 	//Print final output
 	printResourceTable();
 	printProcessTable();
 	printStatistics();
+	printResourceProfile();
+	printLifecycleReport();
+	if (federatedPartitions > 0) {
+		publishPartitionStats();
+		printFederationReport();
+	}
 
-	cleanup_shared_memory(); //cleanup
+	if (statsfilename) {
+		writeStatisticsJson(statsfilename);
+	}
 
-	//At the end of main, before cleanup, print final statistics
-	printStatistics();
-	if (logfile) fclose(logfile);
+	cleanup_shared_memory(); //cleanup
 
 	return 0;
 }
@@ -1,6 +1,8 @@
 //Author: Tu Le
 //CS4760 Project 5
 #include <sys/types.h> //Include for pid_t
+#include <stdint.h>
+#include <stdatomic.h>
 #ifndef SHARED_H_
 #define SHARED_H_
 
@@ -10,15 +12,114 @@
 #define REQUEST_RESOURCE 1
 #define RELEASE_RESOURCE 2
 #define TERMINATE 3
+#define CLAIM_RESOURCES 4 //worker declares its max claim vector in counts[]
+#define REQUEST_VECTOR 5 //request all of counts[] atomically
+#define RELEASE_VECTOR 6 //release all of counts[] at once
+#define RELEASE_ALL_TERMINATE 7 //release everything held and exit, no reply
 
-#pragma pack(push, 1)
+//worker_message status values
+#define STATUS_DENIED 0
+#define STATUS_GRANTED 1
+#define STATUS_PREEMPTED 2 //oss revoked one instance of resourceId to break a deadlock
+
+//All worker -> oss messages use this mtype; replies use the worker's pid
+#define OSS_MTYPE 1
+
+//Tag written at the start of the shared segment so workers can verify ownership
+#define OSS_SHM_MAGIC 0x4F535335
 
+#define PROCESS_SLOTS 18 //size of oss's process table
+
+//Lease words: owner pid in the high 32 bits, instances still unclaimed in the low 32.
+//A worker claims with one compare-and-swap; oss revokes with one exchange.
+#define LEASE_WORD(pid, count) (((uint64_t)(uint32_t)(pid) << 32) | (uint32_t)(count))
+#define LEASE_PID(word) ((pid_t)((word) >> 32))
+#define LEASE_COUNT(word) ((int)((word) & 0xFFFFFFFFu))
+
+//Sleeper words: wake generation in the high 32 bits, workers asleep in it in the low 32. Every wakeup
+//starts a new generation with nobody in it, so a worker that was woken but hasn't run yet is not counted.
+#define SLEEPERS_WORD(gen, count) (((uint64_t)(uint32_t)(gen) << 32) | (uint32_t)(count))
+#define SLEEPERS_GEN(word) ((uint32_t)((word) >> 32))
+#define SLEEPERS_COUNT(word) ((int)((word) & 0xFFFFFFFFu))
 
 typedef struct {
 	unsigned int seconds;
 	unsigned int nanoseconds;
 } SimulatedClock;
 
+//Availability and pre-approved leases oss publishes for workers (all zero while leasing is off)
+typedef struct {
+	_Atomic uint64_t lease[PROCESS_SLOTS][NUM_RESOURCES]; //indexed by oss process slot
+	_Atomic int published[NUM_RESOURCES]; //oss's available[] as of the last reconcile
+	_Atomic unsigned int fastGrants; //requests workers served from their own lease
+} LeaseTable;
+
+//What a worker re-spawned from a checkpoint takes over from the process that held its slot
+typedef struct {
+	int held[NUM_RESOURCES];
+	int claim[NUM_RESOURCES];
+} AdoptedState;
+
+//Simulated-time pacing (oss -t). With sim or ff, workers sleep until a simulated deadline by waiting
+//on wakeSeq with a futex; oss bumps it and wakes them once the earliest deadline has passed.
+#define PACING_WALL 0 //workers sleep in wall-clock time (usleep)
+#define PACING_SIM 1 //workers sleep in simulated time
+#define PACING_FAST_FORWARD 2 //as sim, and oss skips ahead while every worker is asleep or blocked
+
+typedef struct {
+	int mode;
+	_Atomic int64_t nowNs; //simulated time, published by oss every tick
+	_Atomic int64_t earliestNs; //earliest deadline of a sleeping worker, INT64_MAX if none
+	_Atomic uint32_t wakeSeq; //futex word
+	_Atomic uint64_t sleepers; //SLEEPERS_WORD: wake generation and the workers waiting on a deadline in it
+} PacingState;
+
+//Federated resource managers (oss -F). Resource r is owned by partition owner[r]; each partition is its
+//own oss process with its own message queue, and workers send each request to the owner's queue.
+#define MAX_PARTITIONS NUM_RESOURCES
+
+//Counters a partition publishes when it stops, for the primary's report
+typedef struct {
+	int requests; //per resource asked for, as in the contention profile
+	int grants;
+	int grantsAfterWait;
+	int waits; //per resource waited on, as in the contention profile
+	int adopted; //workers first seen through one of their requests
+	int snapshots; //wait-for snapshots sent for deadlock detection
+	int blockedReported; //blocked workers listed in those snapshots
+	int deadlocksFound; //primary only: deadlocks confirmed across partitions
+	int cpu; //CPU the partition was pinned to, -1 = not pinned
+} PartitionStats;
+
+//A worker's declared max claim, published by the primary when it accepts the claim
+typedef struct {
+	pid_t pid; //0 = slot free
+	int claim[NUM_RESOURCES];
+} PublishedClaim;
+
+typedef struct {
+	int partitions; //0 = not federated, everything goes to msqid
+	int msqid[MAX_PARTITIONS]; //request queue of each partition, [0] is the primary's
+	int owner[NUM_RESOURCES];
+	PartitionStats stats[MAX_PARTITIONS];
+	PublishedClaim claims[PROCESS_SLOTS]; //by the primary's slot, so every partition enforces the same claim
+} FederationState;
+
+//Per-run shared segment. Created with IPC_PRIVATE so concurrent runs never collide.
+//Kept out of the packed block so the lease atomics stay naturally aligned.
+typedef struct {
+	unsigned int magic; //OSS_SHM_MAGIC once oss has initialized the segment
+	unsigned int runId; //run ID of the owning oss instance
+	pid_t ownerPid; //pid of the owning oss instance
+	SimulatedClock clock;
+	LeaseTable leases;
+	AdoptedState adopt[PROCESS_SLOTS]; //indexed by oss process slot, filled before the worker is spawned
+	PacingState pacing;
+	FederationState federation;
+} SharedState;
+
+#pragma pack(push, 1)
+
 typedef struct {
 	int occupied;
 	pid_t pid;
@@ -43,14 +144,17 @@ typedef struct {
 
 //Message structures for OSS <-> worker communication
 struct oss_message {
-	long mtype; // PID of the destination process
+	long mtype; // OSS_MTYPE
+	pid_t pid; // PID of the sending worker
 	int command;
 	int resourceId;
+	int counts[NUM_RESOURCES]; // per-resource vector (CLAIM_RESOURCES, REQUEST_VECTOR, RELEASE_VECTOR)
 };
 
 struct worker_message {
 	long mtype; // PID of the destination process (user_proc)
 	int status;
+	int resourceId; // resource revoked (STATUS_PREEMPTED)
 };
 
 #pragma pack(pop)
@@ -0,0 +1,383 @@
+//Author: Tu Le
+//CS4760 Project 5
+//Parameter sweep runner: runs oss over a grid of settings in parallel and aggregates the results
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+
+#define MAX_GRID_VALUES 16
+#define MAX_EXTRA_ARGS 16
+#define MAX_OSS_ARGS 64
+#define MAX_METRICS 192
+#define METRIC_NAME_LEN 64
+
+//One point in the parameter grid
+typedef struct {
+	int n;
+	int i;
+	int s;
+	const char *extra; //extra oss arguments ("" if none)
+} SweepConfig;
+
+//One oss run of a config
+typedef struct {
+	int config;
+	int rep;
+	pid_t pid;
+	int exitStatus;
+	int ok; //stats file was read successfully
+	double metrics[MAX_METRICS];
+	int hasMetric[MAX_METRICS];
+} SweepRun;
+
+char metricNames[MAX_METRICS][METRIC_NAME_LEN];
+int numMetrics = 0;
+
+const char *outdir = "sweep_out";
+const char *ossPath = "./oss";
+
+//Parse a comma separated list of ints ("10,20,40")
+int parse_int_list(const char *arg, int *values) {
+	int count = 0;
+	char *copy = strdup(arg);
+	for (char *tok = strtok(copy, ","); tok && count < MAX_GRID_VALUES; tok = strtok(NULL, ",")) {
+		values[count++] = atoi(tok);
+	}
+	free(copy);
+	return count;
+}
+
+//Look up (or register) a metric column by name
+int metric_index(const char *name) {
+	for (int i = 0; i < numMetrics; i++) {
+		if (strcmp(metricNames[i], name) == 0) return i;
+	}
+	if (numMetrics >= MAX_METRICS) return -1;
+	snprintf(metricNames[numMetrics], METRIC_NAME_LEN, "%s", name);
+	return numMetrics++;
+}
+
+//Write str as a JSON string literal, escaped the same way oss escapes its -w profile
+void write_json_string(FILE *fp, const char *str) {
+	fputc('"', fp);
+	for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\') fprintf(fp, "\\%c", *c);
+		else if (*c < 0x20) fprintf(fp, "\\u%04x", *c);
+		else fputc(*c, fp);
+	}
+	fputc('"', fp);
+}
+
+//Write str as a quoted CSV field; quotes inside it are doubled
+void write_csv_string(FILE *fp, const char *str) {
+	fputc('"', fp);
+	for (const char *c = str; *c; c++) {
+		if (*c == '"') fputc('"', fp);
+		fputc(*c, fp);
+	}
+	fputc('"', fp);
+}
+
+//Read the flat JSON object written by oss -o. Non-numeric values are skipped.
+int read_stats(const char *path, SweepRun *run) {
+	FILE *fp = fopen(path, "r");
+	if (!fp) return -1;
+
+	char line[256];
+	while (fgets(line, sizeof(line), fp)) {
+		char name[METRIC_NAME_LEN];
+		double value;
+		if (sscanf(line, " \"%63[^\"]\" : %lf", name, &value) == 2) {
+			int idx = metric_index(name);
+			if (idx >= 0) {
+				run->metrics[idx] = value;
+				run->hasMetric[idx] = 1;
+			}
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+//Two-sided 95% Student t critical value for df degrees of freedom
+double t_critical_95(int df) {
+	static const double table[] = {
+		0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+	};
+	if (df <= 0) return 0;
+	if (df <= 30) return table[df];
+	return 1.960;
+}
+
+//Fork and exec one oss run; stdout/stderr go to the run's own log
+pid_t launch_run(const SweepConfig *cfg, int runIndex) {
+	char logpath[512], statspath[512], osslog[512];
+	snprintf(statspath, sizeof(statspath), "%s/run_%d.json", outdir, runIndex);
+	//The outdir may hold an earlier sweep; its stats must never stand in for a run that wrote none
+	unlink(statspath);
+
+	pid_t pid = fork();
+	if (pid != 0) return pid;
+
+	snprintf(logpath, sizeof(logpath), "%s/run_%d.out", outdir, runIndex);
+	snprintf(osslog, sizeof(osslog), "%s/run_%d.log", outdir, runIndex);
+
+	int fd = open(logpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd != -1) {
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+	}
+
+	char nbuf[16], ibuf[16], sbuf[16];
+	snprintf(nbuf, sizeof(nbuf), "%d", cfg->n);
+	snprintf(ibuf, sizeof(ibuf), "%d", cfg->i);
+	snprintf(sbuf, sizeof(sbuf), "%d", cfg->s);
+
+	char *args[MAX_OSS_ARGS];
+	int argc = 0;
+	args[argc++] = (char *)ossPath;
+	args[argc++] = "-n"; args[argc++] = nbuf;
+	args[argc++] = "-i"; args[argc++] = ibuf;
+	args[argc++] = "-s"; args[argc++] = sbuf;
+	args[argc++] = "-f"; args[argc++] = osslog;
+	args[argc++] = "-o"; args[argc++] = statspath;
+
+	//Split the extra arguments on whitespace
+	char *extra = strdup(cfg->extra);
+	for (char *tok = strtok(extra, " \t"); tok && argc < MAX_OSS_ARGS - 1; tok = strtok(NULL, " \t")) {
+		args[argc++] = tok;
+	}
+	args[argc] = NULL;
+
+	execv(ossPath, args);
+	perror("execv oss");
+	_exit(127);
+}
+
+void usage(const char *prog) {
+	printf("Usage: %s [-h] [-j jobs] [-r reps] [-n list] [-i list] [-s list] [-a extraArgs]... [-d outdir] [-x oss]\n", prog);
+	printf("Options:\n");
+	printf("  -h  Show this help message\n");
+	printf("  -j  Number of simulations to run in parallel (default: online cores)\n");
+	printf("  -r  Repetitions per grid point (default: 3)\n");
+	printf("  -n  Comma separated values for oss -n (default: 18)\n");
+	printf("  -i  Comma separated values for oss -i (default: 100)\n");
+	printf("  -s  Comma separated values for oss -s (default: 5)\n");
+	printf("  -a  Extra oss arguments, quoted; repeat to add grid values (e.g. -a \"-p fifo\" -a \"-p snf\")\n");
+	printf("  -d  Output directory (default: sweep_out)\n");
+	printf("  -x  Path to the oss binary (default: ./oss)\n");
+	printf("Writes <outdir>/runs.csv (one row per run) and <outdir>/summary.csv and summary.json\n");
+	printf("(mean, standard deviation and 95%% confidence half-width per grid point).\n");
+}
+
+int main(int argc, char *argv[]) {
+	int nValues[MAX_GRID_VALUES] = {18}, nCount = 1;
+	int iValues[MAX_GRID_VALUES] = {100}, iCount = 1;
+	int sValues[MAX_GRID_VALUES] = {5}, sCount = 1;
+	const char *extraValues[MAX_EXTRA_ARGS] = {""};
+	int extraCount = 0;
+	int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int reps = 3;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hj:r:n:i:s:a:d:x:")) != -1) {
+		switch (opt) {
+			case 'h':
+				usage(argv[0]);
+				exit(0);
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			case 'r':
+				reps = atoi(optarg);
+				break;
+			case 'n':
+				nCount = parse_int_list(optarg, nValues);
+				break;
+			case 'i':
+				iCount = parse_int_list(optarg, iValues);
+				break;
+			case 's':
+				sCount = parse_int_list(optarg, sValues);
+				break;
+			case 'a':
+				if (extraCount < MAX_EXTRA_ARGS) extraValues[extraCount++] = optarg;
+				break;
+			case 'd':
+				outdir = optarg;
+				break;
+			case 'x':
+				ossPath = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+	if (extraCount == 0) extraCount = 1;
+	if (jobs < 1) jobs = 1;
+	if (reps < 1) reps = 1;
+	if (nCount == 0 || iCount == 0 || sCount == 0) {
+		fprintf(stderr, "sweep: empty parameter list\n");
+		exit(1);
+	}
+
+	if (mkdir(outdir, 0755) == -1 && errno != EEXIST) {
+		perror("mkdir");
+		exit(1);
+	}
+
+	//Expand the grid
+	int numConfigs = nCount * iCount * sCount * extraCount;
+	SweepConfig *configs = calloc(numConfigs, sizeof(SweepConfig));
+	int c = 0;
+	for (int a = 0; a < nCount; a++)
+		for (int b = 0; b < iCount; b++)
+			for (int d = 0; d < sCount; d++)
+				for (int e = 0; e < extraCount; e++) {
+					configs[c].n = nValues[a];
+					configs[c].i = iValues[b];
+					configs[c].s = sValues[d];
+					configs[c].extra = extraValues[e];
+					c++;
+				}
+
+	int numRuns = numConfigs * reps;
+	SweepRun *runs = calloc(numRuns, sizeof(SweepRun));
+	for (int r = 0; r < numRuns; r++) {
+		runs[r].config = r / reps;
+		runs[r].rep = r % reps;
+	}
+
+	printf("sweep: %d grid points x %d reps = %d runs, %d in parallel\n", numConfigs, reps, numRuns, jobs);
+
+	//Keep up to 'jobs' oss instances running; each has private IPC so they don't interfere
+	int next = 0, running = 0, finished = 0;
+	while (finished < numRuns) {
+		while (running < jobs && next < numRuns) {
+			runs[next].pid = launch_run(&configs[runs[next].config], next);
+			if (runs[next].pid == -1) {
+				perror("fork");
+				runs[next].exitStatus = -1;
+				finished++;
+			} else {
+				running++;
+			}
+			next++;
+		}
+
+		int status;
+		pid_t done = wait(&status);
+		if (done == -1) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		for (int r = 0; r < numRuns; r++) {
+			if (runs[r].pid == done) {
+				runs[r].exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+				char statspath[512];
+				snprintf(statspath, sizeof(statspath), "%s/run_%d.json", outdir, r);
+				//A crashed or killed oss may have left a partial file; only a clean exit counts
+				runs[r].ok = runs[r].exitStatus == 0 && read_stats(statspath, &runs[r]) == 0;
+				running--;
+				finished++;
+				printf("sweep: run %d/%d (n=%d i=%d s=%d %s) exit %d%s\n", finished, numRuns,
+						configs[runs[r].config].n, configs[runs[r].config].i, configs[runs[r].config].s,
+						configs[runs[r].config].extra, runs[r].exitStatus, runs[r].ok ? "" : " (failed)");
+				break;
+			}
+		}
+	}
+
+	//Per-run rows
+	char path[512];
+	snprintf(path, sizeof(path), "%s/runs.csv", outdir);
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		perror("fopen runs.csv");
+		exit(1);
+	}
+	fprintf(fp, "run,n,i,s,extra,rep,exit");
+	for (int m = 0; m < numMetrics; m++) fprintf(fp, ",%s", metricNames[m]);
+	fprintf(fp, "\n");
+	for (int r = 0; r < numRuns; r++) {
+		SweepConfig *cfg = &configs[runs[r].config];
+		fprintf(fp, "%d,%d,%d,%d,", r, cfg->n, cfg->i, cfg->s);
+		write_csv_string(fp, cfg->extra);
+		fprintf(fp, ",%d,%d", runs[r].rep, runs[r].exitStatus);
+		for (int m = 0; m < numMetrics; m++) {
+			if (runs[r].hasMetric[m]) fprintf(fp, ",%.9g", runs[r].metrics[m]);
+			else fprintf(fp, ",");
+		}
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+
+	//Aggregate per grid point: mean, sample standard deviation and 95% CI half-width
+	snprintf(path, sizeof(path), "%s/summary.csv", outdir);
+	FILE *csv = fopen(path, "w");
+	snprintf(path, sizeof(path), "%s/summary.json", outdir);
+	FILE *json = fopen(path, "w");
+	if (!csv || !json) {
+		perror("fopen summary");
+		exit(1);
+	}
+	fprintf(csv, "n,i,s,extra,runs,metric,mean,stddev,ci95\n");
+	fprintf(json, "[\n");
+	for (c = 0; c < numConfigs; c++) {
+		fprintf(json, "  {\"n\": %d, \"i\": %d, \"s\": %d, \"extra\": ", configs[c].n, configs[c].i, configs[c].s);
+		write_json_string(json, configs[c].extra);
+		fprintf(json, ", \"metrics\": {");
+		int first = 1;
+		for (int m = 0; m < numMetrics; m++) {
+			if (strcmp(metricNames[m], "run_id") == 0) continue; //an identifier, not a measurement
+			double sum = 0, sumsq = 0;
+			int count = 0;
+			for (int r = c * reps; r < (c + 1) * reps; r++) {
+				if (!runs[r].ok || !runs[r].hasMetric[m]) continue;
+				sum += runs[r].metrics[m];
+				count++;
+			}
+			double mean = count ? sum / count : 0;
+			for (int r = c * reps; r < (c + 1) * reps; r++) {
+				if (!runs[r].ok || !runs[r].hasMetric[m]) continue;
+				sumsq += (runs[r].metrics[m] - mean) * (runs[r].metrics[m] - mean);
+			}
+			double stddev = count > 1 ? sqrt(sumsq / (count - 1)) : 0;
+			double ci = count > 1 ? t_critical_95(count - 1) * stddev / sqrt(count) : 0;
+
+			fprintf(csv, "%d,%d,%d,", configs[c].n, configs[c].i, configs[c].s);
+			write_csv_string(csv, configs[c].extra);
+			fprintf(csv, ",%d,%s,%.9g,%.9g,%.9g\n", count, metricNames[m], mean, stddev, ci);
+			fprintf(json, "%s\n    \"%s\": {\"runs\": %d, \"mean\": %.9g, \"stddev\": %.9g, \"ci95\": %.9g}",
+					first ? "" : ",", metricNames[m], count, mean, stddev, ci);
+			first = 0;
+		}
+		fprintf(json, "\n  }}%s\n", c + 1 < numConfigs ? "," : "");
+	}
+	fprintf(json, "]\n");
+	fclose(csv);
+	fclose(json);
+
+	int failed = 0;
+	for (int r = 0; r < numRuns; r++) {
+		if (!runs[r].ok) failed++;
+	}
+	printf("sweep: results in %s/runs.csv, %s/summary.csv, %s/summary.json (%d failed runs left out)\n",
+			outdir, outdir, outdir, failed);
+
+	free(configs);
+	free(runs);
+	return failed ? 1 : 0;
+}
@@ -15,9 +15,11 @@
 #include <signal.h>
 #include <stdbool.h> //bool type
 #include <string.h>
-
-//Constants 
-#define MSGKEY 12345
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 //Constants for message commands - match oss.c
 #define REQUEST_RESOURCE 1
@@ -25,66 +27,403 @@
 #define TERMINATE 3
 #define MAX_RESOURCES_PER_PROCESS 3
 #define MAX_REQUESTS 15
+#define MAX_PROFILE_LINE 256
+
+//Synthetic workload profile, passed by oss -w as a file name or an inline "key=value,..." list.
+//The defaults reproduce the original fixed behaviour.
+#define POP_UNIFORM 0 //every resource equally likely
+#define POP_ZIPF 1 //resource r has weight 1/(r+1)^s
+#define POP_HOTSPOT 2 //the first hotCount resources share hotWeight of the picks
+#define ARRIVAL_FIXED 0 //bound_B jitter plus 50 ms between actions
+#define ARRIVAL_POISSON 1 //exponential gaps with the given mean
+#define ARRIVAL_BURSTY 2 //Poisson while "on", silent while "off"
+#define HOLD_UNIFORM 0
+#define HOLD_EXP 1
+#define HOLD_PARETO 2
+
+typedef struct {
+	int popularity;
+	double zipfS;
+	int hotCount;
+	double hotWeight;
+	int arrival;
+	double arrivalMeanMs;
+	double burstOnMs;
+	double burstOffMs;
+	int hold;
+	double holdMinMs;
+	double holdMaxMs;
+	double holdMeanMs;
+	double paretoAlpha;
+	int requestPct; //chance to request rather than release while holding something
+	int terminatePct; //chance to terminate when idle after 5 requests
+	int bundlePct; //chance of an all-or-nothing bundle when holding nothing
+	int maxRequests;
+	int maxHeld;
+	int maxMulti; //most instances of one resource in a single request
+	bool seeded;
+	uint64_t seed;
+} Workload;
 
+Workload workload = {
+	.popularity = POP_UNIFORM, .zipfS = 1.0, .hotCount = 1, .hotWeight = 0.8,
+	.arrival = ARRIVAL_FIXED, .arrivalMeanMs = 100, .burstOnMs = 1000, .burstOffMs = 1000,
+	.hold = HOLD_UNIFORM, .holdMinMs = 100, .holdMaxMs = 600, .holdMeanMs = 350, .paretoAlpha = 1.5,
+	.requestPct = 75, .terminatePct = 25, .bundlePct = 50,
+	.maxRequests = MAX_REQUESTS, .maxHeld = MAX_RESOURCES_PER_PROCESS, .maxMulti = 1,
+	.seeded = false, .seed = 0
+};
+double resourceWeight[NUM_RESOURCES];
+uint64_t rngState;
+struct timespec workerStart;
+
+SharedState *sharedState = NULL;
 SimulatedClock *simClock;
 int shmid;
 int msqid;
+unsigned int runId;
 volatile sig_atomic_t terminating = 0;
 int myResources[NUM_RESOURCES] = {0};
+int myClaim[NUM_RESOURCES] = {0}; //max instances of each resource we will ever hold
+int lastReplyStatus = -1; //status of oss's last reply, -1 if the last message got none
+
+
+//Per-worker RNG (splitmix64), so a seeded profile gives each worker the same stream every run
+uint64_t rng_next() {
+	uint64_t z = (rngState += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+int rng_below(int n) {
+	return n > 0 ? (int)(rng_next() % (uint64_t)n) : 0;
+}
+
+//Uniform in (0, 1)
+double rng_uniform() {
+	return ((rng_next() >> 11) + 0.5) / 9007199254740992.0;
+}
+
+double rng_exponential(double mean) {
+	return -mean * log(rng_uniform());
+}
+
+//Parse one "key=value" setting. Returns false if it isn't understood.
+bool parse_workload_setting(const char *key, const char *value) {
+	if (strcmp(key, "seed") == 0) {
+		workload.seeded = true;
+		workload.seed = strtoull(value, NULL, 10);
+	} else if (strcmp(key, "popularity") == 0) {
+		if (strcmp(value, "uniform") == 0) {
+			workload.popularity = POP_UNIFORM;
+		} else if (sscanf(value, "zipf:%lf", &workload.zipfS) == 1) {
+			workload.popularity = POP_ZIPF;
+		} else if (sscanf(value, "hotspot:%d:%lf", &workload.hotCount, &workload.hotWeight) == 2 &&
+				workload.hotCount > 0 && workload.hotCount < NUM_RESOURCES &&
+				workload.hotWeight > 0 && workload.hotWeight < 1) {
+			workload.popularity = POP_HOTSPOT;
+		} else {
+			return false;
+		}
+	} else if (strcmp(key, "arrival") == 0) {
+		if (strcmp(value, "fixed") == 0) {
+			workload.arrival = ARRIVAL_FIXED;
+		} else if (sscanf(value, "poisson:%lf", &workload.arrivalMeanMs) == 1 && workload.arrivalMeanMs > 0) {
+			workload.arrival = ARRIVAL_POISSON;
+		} else if (sscanf(value, "bursty:%lf:%lf:%lf", &workload.burstOnMs, &workload.burstOffMs,
+				&workload.arrivalMeanMs) == 3 && workload.burstOnMs > 0 && workload.burstOffMs >= 0 &&
+				workload.arrivalMeanMs > 0) {
+			workload.arrival = ARRIVAL_BURSTY;
+		} else {
+			return false;
+		}
+	} else if (strcmp(key, "hold") == 0) {
+		if (sscanf(value, "uniform:%lf:%lf", &workload.holdMinMs, &workload.holdMaxMs) == 2 &&
+				workload.holdMinMs >= 0 && workload.holdMaxMs > workload.holdMinMs) {
+			workload.hold = HOLD_UNIFORM;
+		} else if (sscanf(value, "exp:%lf", &workload.holdMeanMs) == 1 && workload.holdMeanMs > 0) {
+			workload.hold = HOLD_EXP;
+		} else if (sscanf(value, "pareto:%lf:%lf", &workload.holdMinMs, &workload.paretoAlpha) == 2 &&
+				workload.holdMinMs > 0 && workload.paretoAlpha > 0) {
+			workload.hold = HOLD_PARETO;
+		} else {
+			return false;
+		}
+	} else if (strcmp(key, "request_pct") == 0) {
+		workload.requestPct = atoi(value);
+	} else if (strcmp(key, "terminate_pct") == 0) {
+		workload.terminatePct = atoi(value);
+	} else if (strcmp(key, "bundle_pct") == 0) {
+		workload.bundlePct = atoi(value);
+	} else if (strcmp(key, "max_requests") == 0) {
+		workload.maxRequests = atoi(value);
+	} else if (strcmp(key, "max_held") == 0) {
+		workload.maxHeld = atoi(value);
+		if (workload.maxHeld < 1 || workload.maxHeld > NUM_RESOURCES * NUM_INSTANCES) return false;
+	} else if (strcmp(key, "max_multi") == 0) {
+		workload.maxMulti = atoi(value);
+		if (workload.maxMulti < 1 || workload.maxMulti > NUM_INSTANCES) return false;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+//Split "key = value" (surrounding blanks allowed) and apply it
+bool parse_workload_pair(char *pair) {
+	char *eq = strchr(pair, '=');
+	if (eq == NULL) return false;
+	*eq = '\0';
+	char key[64], value[MAX_PROFILE_LINE];
+	if (sscanf(pair, " %63s", key) != 1 || sscanf(eq + 1, " %255s", value) != 1) return false;
+	return parse_workload_setting(key, value);
+}
+
+//Load a profile: a file with one setting per line (# starts a comment), or an inline comma-separated list
+bool load_workload(const char *spec) {
+	char line[MAX_PROFILE_LINE];
+	FILE *fp = fopen(spec, "r");
+	if (fp != NULL) {
+		while (fgets(line, sizeof(line), fp)) {
+			char *comment = strchr(line, '#');
+			if (comment) *comment = '\0';
+			if (strspn(line, " \t\r\n") == strlen(line)) continue;
+			if (!parse_workload_pair(line)) {
+				fprintf(stderr, "user_proc %d: bad workload setting in %s: %s", getpid(), spec, line);
+				fclose(fp);
+				return false;
+			}
+		}
+		fclose(fp);
+		return true;
+	}
+
+	snprintf(line, sizeof(line), "%s", spec);
+	for (char *pair = strtok(line, ","); pair != NULL; pair = strtok(NULL, ",")) {
+		char copy[MAX_PROFILE_LINE];
+		snprintf(copy, sizeof(copy), "%s", pair);
+		if (!parse_workload_pair(copy)) {
+			fprintf(stderr, "user_proc %d: bad workload setting '%s'\n", getpid(), pair);
+			return false;
+		}
+	}
+	return true;
+}
 
+void setup_workload(int workerIndex) {
+	if (workload.seeded) {
+		rngState = workload.seed ^ ((uint64_t)(workerIndex + 1) * 0xD1B54A32D192ED03ULL);
+	} else {
+		rngState = (uint64_t)getpid() + (uint64_t)time(NULL); //Better randomization
+	}
+	for (int r = 0; r < NUM_RESOURCES; r++) {
+		switch (workload.popularity) {
+			case POP_ZIPF:
+				resourceWeight[r] = 1.0 / pow(r + 1, workload.zipfS);
+				break;
+			case POP_HOTSPOT:
+				resourceWeight[r] = r < workload.hotCount ? workload.hotWeight / workload.hotCount :
+					(1.0 - workload.hotWeight) / (NUM_RESOURCES - workload.hotCount);
+				break;
+			default:
+				resourceWeight[r] = 1.0;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &workerStart);
+}
+
+//Pick a resource by popularity among those allowed, -1 if none is
+int pick_weighted(const bool *allowed) {
+	double total = 0;
+	for (int r = 0; r < NUM_RESOURCES; r++) {
+		if (allowed[r]) total += resourceWeight[r];
+	}
+	if (total <= 0) return -1;
+	double x = rng_uniform() * total;
+	int last = -1;
+	for (int r = 0; r < NUM_RESOURCES; r++) {
+		if (!allowed[r]) continue;
+		last = r;
+		x -= resourceWeight[r];
+		if (x < 0) return r;
+	}
+	return last;
+}
+
+long long workerStartSimNs = 0; //simulated time we attached, for bursty arrivals under simulated pacing
+
+long long sim_now_ns() {
+	return atomic_load(&sharedState->pacing.nowNs);
+}
+
+//Lower the shared earliest deadline to ours if it is later
+void publish_deadline(long long deadline) {
+	_Atomic int64_t *earliest = &sharedState->pacing.earliestNs;
+	int64_t current = atomic_load(earliest);
+	while (deadline < current && !atomic_compare_exchange_weak(earliest, &current, deadline)) {
+	}
+}
+
+//Count ourselves asleep in the current wake generation. Returns the generation joined.
+uint32_t sleeper_join() {
+	_Atomic uint64_t *sleepers = &sharedState->pacing.sleepers;
+	uint64_t word = atomic_load(sleepers);
+	while (!atomic_compare_exchange_weak(sleepers, &word, word + 1)) {
+	}
+	return SLEEPERS_GEN(word);
+}
+
+//Stop counting ourselves; nothing to do once oss has started a new generation, which dropped everyone
+void sleeper_leave(uint32_t gen) {
+	_Atomic uint64_t *sleepers = &sharedState->pacing.sleepers;
+	uint64_t word = atomic_load(sleepers);
+	while (SLEEPERS_GEN(word) == gen && !atomic_compare_exchange_weak(sleepers, &word, word - 1)) {
+	}
+}
+
+//Sleep for us microseconds of wall time, or of simulated time when oss paces on the simulated clock
+void pace_sleep_us(useconds_t us) {
+	if (sharedState->pacing.mode == PACING_WALL) {
+		usleep(us);
+		return;
+	}
+	PacingState *pacing = &sharedState->pacing;
+	long long deadline = sim_now_ns() + (long long)us * 1000;
+	while (!terminating && sim_now_ns() < deadline) {
+		uint32_t seq = atomic_load(&pacing->wakeSeq);
+		//Publish before counting ourselves, so oss never sees a sleeper without a deadline; oss clears
+		//the deadline and empties the count whenever it wakes anyone, so both are redone every round
+		publish_deadline(deadline);
+		uint32_t gen = sleeper_join();
+		if (sim_now_ns() >= deadline) {
+			sleeper_leave(gen);
+			break;
+		}
+		//Bounded so we still notice if oss is gone
+		struct timespec timeout = {0, 100000000};
+		syscall(SYS_futex, (uint32_t *)&pacing->wakeSeq, FUTEX_WAIT, seq, &timeout, NULL, 0);
+		sleeper_leave(gen);
+		if (getppid() != sharedState->ownerPid) break;
+	}
+}
+
+//How long to hold what we just got, in microseconds
+useconds_t sample_hold_us() {
+	double ms;
+	switch (workload.hold) {
+		case HOLD_EXP:
+			ms = rng_exponential(workload.holdMeanMs);
+			break;
+		case HOLD_PARETO:
+			ms = workload.holdMinMs / pow(rng_uniform(), 1.0 / workload.paretoAlpha);
+			break;
+		default:
+			ms = workload.holdMinMs + rng_uniform() * (workload.holdMaxMs - workload.holdMinMs);
+	}
+	if (ms > 10000) ms = 10000; //heavy tails shouldn't park a worker for the whole run
+	return (useconds_t)(ms * 1000);
+}
+
+//Gap before the next action, in microseconds
+useconds_t sample_gap_us(int bound_B) {
+	switch (workload.arrival) {
+		case ARRIVAL_POISSON:
+			return (useconds_t)(rng_exponential(workload.arrivalMeanMs) * 1000);
+		case ARRIVAL_BURSTY: {
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			double elapsedMs = (now.tv_sec - workerStart.tv_sec) * 1000.0 + (now.tv_nsec - workerStart.tv_nsec) / 1e6;
+			if (sharedState->pacing.mode != PACING_WALL) {
+				elapsedMs = (sim_now_ns() - workerStartSimNs) / 1e6;
+			}
+			double cycle = workload.burstOnMs + workload.burstOffMs;
+			double phase = fmod(elapsedMs, cycle);
+			double gapMs = rng_exponential(workload.arrivalMeanMs);
+			if (phase + gapMs >= workload.burstOnMs && phase + gapMs < cycle) {
+				gapMs = cycle - phase; //would land in the off period: wait for the next burst
+			}
+			return (useconds_t)(gapMs * 1000);
+		}
+		default:
+			return rng_below(bound_B) + 50000;
+	}
+}
 
 void handle_sigterm(int sig) {
 	terminating = 1;
 	printf("Process %d received SIGTERM, exiting.\n", getpid());
 }
 
+//Attach to the segment oss passed us and make sure it really belongs to our parent's run
 int attach_shared_memory() {
-	key_t key = ftok("oss.c", 1); //Same key as in oss.c
-	if (key == -1) {
-		perror("ftok");
+	sharedState = (SharedState *)shmat(shmid, NULL, 0);
+	if (sharedState == (SharedState *) -1) {
+		perror("shmat");
+		sharedState = NULL;
 		return 1;
 	}
-	
-	shmid = shmget(key, sizeof(SimulatedClock), 0666); //No IPC_CREAT
-	if (shmid == -1) {
-		perror("shmget");
+
+	if (sharedState->magic != OSS_SHM_MAGIC || sharedState->runId != runId ||
+			sharedState->ownerPid != getppid()) {
+		fprintf(stderr, "user_proc %d: shared segment %d is not owned by run %u (oss %d)\n",
+				getpid(), shmid, runId, getppid());
+		shmdt(sharedState);
+		sharedState = NULL;
 		return 1;
 	}
+	simClock = &sharedState->clock;
+	workerStartSimNs = sim_now_ns();
+	return 0;
+}
 
-	simClock = (SimulatedClock *)shmat(shmid, NULL, 0);
-	if (simClock == (SimulatedClock *) -1) {
-		perror("shmat");
+//Only talk on a queue created by the same user as our segment
+int check_message_queue() {
+	struct msqid_ds info;
+	if (msgctl(msqid, IPC_STAT, &info) == -1) {
+		perror("msgctl");
+		return 1;
+	}
+	if (info.msg_perm.cuid != geteuid()) {
+		fprintf(stderr, "user_proc %d: message queue %d is not owned by this user\n", getpid(), msqid);
 		return 1;
 	}
 	return 0;
 }
 
 void detach_shared_memory() {
-	if (simClock != (SimulatedClock *)-1) {
-		shmdt(simClock);
+	if (sharedState != NULL) {
+		shmdt(sharedState);
+		sharedState = NULL;
 	}
 }
 
-// Function to safely send a message and wait for response
-bool send_message(int command, int resourceId) {
+// Function to safely send a message (with an optional per-resource vector) to one queue and wait for response
+bool send_vector_message_to(int queue, int command, int resourceId, const int *counts) {
 	if (terminating) {
 		return false;
 	}
 
 	//Validate command
-	if (command != REQUEST_RESOURCE && command != RELEASE_RESOURCE && command != TERMINATE) {
+	if (command != REQUEST_RESOURCE && command != RELEASE_RESOURCE && command != TERMINATE &&
+			command != CLAIM_RESOURCES && command != REQUEST_VECTOR && command != RELEASE_VECTOR) {
 		return false;
 	}
 
 	//Initialize message structure
 	struct oss_message msg;
 	memset(&msg, 0, sizeof(struct oss_message));
-	msg.mtype = getpid();
+	msg.mtype = OSS_MTYPE;
+	msg.pid = getpid();
 	msg.command = command;
 	msg.resourceId = resourceId;
+	if (counts != NULL) {
+		memcpy(msg.counts, counts, sizeof(msg.counts));
+	}
 
 	//Send message
-	if (msgsnd(msqid, &msg, sizeof(struct oss_message) - sizeof(long), 0) == -1) {
+	lastReplyStatus = -1;
+	if (msgsnd(queue, &msg, sizeof(struct oss_message) - sizeof(long), 0) == -1) {
 		return false;
 	}
 
@@ -93,53 +432,164 @@ bool send_message(int command, int resourceId) {
 		struct worker_message response;
 		memset(&response, 0, sizeof(struct worker_message));
 		
-		// Wait for response
-		if (msgrcv(msqid, &response, sizeof(struct worker_message) - sizeof(long), getpid(), 0) == -1) {
-			return false;
+		// Wait for response; a preemption notice may arrive first while we are blocked
+		while (1) {
+			if (msgrcv(queue, &response, sizeof(struct worker_message) - sizeof(long), getpid(), 0) == -1) {
+				return false;
+			}
+			if (response.status != STATUS_PREEMPTED) {
+				break;
+			}
+			// oss took one instance back to break a deadlock; we'll ask for it again later
+			if (response.resourceId >= 0 && response.resourceId < NUM_RESOURCES &&
+					myResources[response.resourceId] > 0) {
+				myResources[response.resourceId]--;
+			}
 		}
-		return response.status == 1;
+		lastReplyStatus = response.status;
+		return response.status == STATUS_GRANTED;
 	}	
 	return true;  
 }
 
-void cleanup_resources() {
-	// Release all held resources
-	for (int i = 0; i < NUM_RESOURCES; i++) {
-		while (myResources[i] > 0) {
-			struct oss_message msg;
-			msg.mtype = getpid();
-			msg.command = RELEASE_RESOURCE;
-			msg.resourceId = i;
-			
-			// Don't wait for response during cleanup
-			if (msgsnd(msqid, &msg, sizeof(struct oss_message) - sizeof(long), IPC_NOWAIT) == -1) {
-				if (errno != EAGAIN) {  // Ignore if message queue is full
-					perror("msgsnd cleanup");
+//The part of counts owned by partition p; false if that part is empty
+bool partition_part(int p, const int *counts, int *part) {
+	bool any = false;
+	for (int j = 0; j < NUM_RESOURCES; j++) {
+		part[j] = sharedState->federation.owner[j] == p ? counts[j] : 0;
+		if (part[j] > 0) any = true;
+	}
+	return any;
+}
+
+//Route a message: with oss -F, requests and releases go to the partition owning the resource,
+//claims and termination to the primary
+bool send_vector_message(int command, int resourceId, const int *counts) {
+	FederationState *fed = &sharedState->federation;
+	if (fed->partitions == 0 || command == TERMINATE || command == CLAIM_RESOURCES) {
+		return send_vector_message_to(msqid, command, resourceId, counts);
+	}
+	if (command == REQUEST_RESOURCE || command == RELEASE_RESOURCE) {
+		if (resourceId < 0 || resourceId >= NUM_RESOURCES) return false;
+		return send_vector_message_to(fed->msqid[fed->owner[resourceId]], command, resourceId, counts);
+	}
+
+	//A vector is split by owner. Requests take the parts in increasing partition order, the same order
+	//for every worker, and give back what they got if a later part is denied.
+	int part[NUM_RESOURCES];
+	bool ok = true;
+	for (int p = 0; p < fed->partitions; p++) {
+		if (!partition_part(p, counts, part)) continue;
+		if (send_vector_message_to(fed->msqid[p], command, resourceId, part)) continue;
+		ok = false;
+		if (command != REQUEST_VECTOR) continue;
+		for (int q = 0; q < p; q++) {
+			if (partition_part(q, counts, part)) send_vector_message_to(fed->msqid[q], RELEASE_VECTOR, resourceId, part);
+		}
+		break;
+	}
+	return ok;
+}
+
+bool send_message(int command, int resourceId) {
+	return send_vector_message(command, resourceId, NULL);
+}
+
+//Serve a request from the lease oss published for us, without a message. False if the lease can't cover it.
+bool claim_from_lease(int resourceId, int count) {
+	static int mySlot = -1;
+	pid_t me = getpid();
+	if (mySlot == -1 || LEASE_PID(atomic_load(&sharedState->leases.lease[mySlot][resourceId])) != me) {
+		mySlot = -1;
+		for (int i = 0; i < PROCESS_SLOTS && mySlot == -1; i++) {
+			for (int j = 0; j < NUM_RESOURCES; j++) {
+				if (LEASE_PID(atomic_load(&sharedState->leases.lease[i][j])) == me) {
+					mySlot = i;
+					break;
 				}
 			}
-			myResources[i]--;
 		}
+		if (mySlot == -1) return false;
 	}
-	
-	// Send final terminate message
+
+	_Atomic uint64_t *word = &sharedState->leases.lease[mySlot][resourceId];
+	uint64_t current = atomic_load(word);
+	do {
+		//The pid check inside the CAS means a revoked or reassigned lease can never be claimed
+		if (LEASE_PID(current) != me || LEASE_COUNT(current) < count) return false;
+	} while (!atomic_compare_exchange_weak(word, &current, LEASE_WORD(me, LEASE_COUNT(current) - count)));
+	atomic_fetch_add(&sharedState->leases.fastGrants, 1);
+	return true;
+}
+
+//Pick the most we will ever hold: at most 2 (or max_multi) of a resource and max_held in total
+void choose_claim() {
+	int perResource = workload.maxMulti > 2 ? workload.maxMulti : 2;
+	int total = 0;
+	int target = 1 + rng_below(workload.maxHeld);
+	while (total < target) {
+		bool allowed[NUM_RESOURCES];
+		for (int r = 0; r < NUM_RESOURCES; r++) {
+			allowed[r] = myClaim[r] < perResource && myClaim[r] < NUM_INSTANCES;
+		}
+		int r = pick_weighted(allowed);
+		if (r == -1) break;
+		myClaim[r]++;
+		total++;
+	}
+}
+
+//Pick a resource we may still request under our claim, by popularity; -1 if none
+int pick_claimed_resource(const int *held) {
+	bool allowed[NUM_RESOURCES];
+	for (int i = 0; i < NUM_RESOURCES; i++) {
+		allowed[i] = held[i] < myClaim[i];
+	}
+	return pick_weighted(allowed);
+}
+
+//Pick a random sub-vector of what we may still claim with at least two instances, false if there isn't one
+bool pick_claimed_bundle(const int *held, int *bundle) {
+	int total = 0;
+	for (int i = 0; i < NUM_RESOURCES; i++) {
+		bundle[i] = myClaim[i] - held[i];
+		if (bundle[i] > 0 && rng_below(2) == 0) bundle[i]--;
+		total += bundle[i];
+	}
+	return total >= 2;
+}
+
+void cleanup_resources() {
+	// Release everything and exit in one message; don't wait for a response during cleanup
 	struct oss_message msg;
-	msg.mtype = getpid();
-	msg.command = TERMINATE;
+	memset(&msg, 0, sizeof(struct oss_message));
+	msg.mtype = OSS_MTYPE;
+	msg.pid = getpid();
+	msg.command = RELEASE_ALL_TERMINATE;
 	msg.resourceId = 0;
 	
-	if (msgsnd(msqid, &msg, sizeof(struct oss_message) - sizeof(long), IPC_NOWAIT) == -1) {
-		if (errno != EAGAIN) {
-			perror("msgsnd terminate");
+	//Every partition of a federated oss holds some of our instances
+	int partitions = 1;
+	if (sharedState != NULL && sharedState->federation.partitions > 0) {
+		partitions = sharedState->federation.partitions;
+	}
+	for (int p = partitions - 1; p >= 0; p--) {
+		int queue = p == 0 ? msqid : sharedState->federation.msqid[p];
+		if (msgsnd(queue, &msg, sizeof(struct oss_message) - sizeof(long), IPC_NOWAIT) == -1) {
+			if (errno != EAGAIN) {  // Ignore if message queue is full
+				perror("msgsnd release all");
+			}
 		}
 	}
+	memset(myResources, 0, sizeof(myResources));
 }
 
 int main(int argc, char *argv[]) {
 	signal(SIGTERM, handle_sigterm);
 	
 	
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <bound_B>\n", argv[0]);
+	if (argc != 5 && argc != 7 && argc != 8) {
+		fprintf(stderr, "Usage: %s <bound_B> <shmid> <msqid> <runId> [<workerIndex> <workloadProfile> [<adoptSlot>]]\n", argv[0]);
 		return 1;
 	}
 
@@ -149,22 +599,38 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	srand(getpid() + time (NULL)); //Better randomization
+	shmid = atoi(argv[2]);
+	msqid = atoi(argv[3]);
+	runId = (unsigned int)strtoul(argv[4], NULL, 10);
+
+	int workerIndex = 0;
+	int adoptSlot = -1; //set when oss re-spawns us from a checkpoint in place of an earlier process
+	if (argc == 8) {
+		adoptSlot = atoi(argv[7]);
+		if (adoptSlot < 0 || adoptSlot >= PROCESS_SLOTS) {
+			fprintf(stderr, "Error: adopt slot must be between 0 and %d\n", PROCESS_SLOTS - 1);
+			return 1;
+		}
+	}
+	if (argc >= 7) {
+		workerIndex = atoi(argv[5]);
+		if (!load_workload(argv[6])) {
+			return 1;
+		}
+	}
+	setup_workload(workerIndex);
 
 	//Attach to shared memory and message queue
 	if (attach_shared_memory() != 0) {
 		return 1;
 	}
 
-	msqid = msgget(MSGKEY, 0);
-	if (msqid == -1) {
-		perror("msgget");
+	if (check_message_queue() != 0) {
 		detach_shared_memory();
 		return 1;
 	}
 
-	//Track resources and start time
-	int myResources[NUM_RESOURCES] = {0};
+	//Track resources and start time (myResources is global so preemption and cleanup see it)
 	//unsigned int start_sec = simClock->seconds;
 	//unsigned int start_ns = simClock->nanoseconds;
 	int total_requests = 0;
@@ -173,12 +639,37 @@ int main(int argc, char *argv[]) {
 	//bool has_waited = false;
 	int operations_since_last_release = 0;
 
+	if (adoptSlot >= 0) {
+		// oss already holds our claim and allocation from the checkpoint; just take them over
+		memcpy(myResources, sharedState->adopt[adoptSlot].held, sizeof(myResources));
+		memcpy(myClaim, sharedState->adopt[adoptSlot].claim, sizeof(myClaim));
+	} else {
+		// Declare our max claim so oss can run banker's avoidance on real numbers
+		choose_claim();
+	}
+	if (adoptSlot < 0 && !send_vector_message(CLAIM_RESOURCES, 0, myClaim)) {
+		detach_shared_memory();
+		//oss stopping us while we waited for the answer is a normal shutdown, not a rejection
+		if (terminating) return 0;
+		if (lastReplyStatus == STATUS_DENIED) {
+			fprintf(stderr, "user_proc %d: claim rejected by oss\n", getpid());
+		} else {
+			fprintf(stderr, "user_proc %d: no answer from oss to our claim\n", getpid());
+		}
+		return 1;
+	}
+
 	// Initial delay to stagger processes
-	usleep(rand() % 100000);
+	pace_sleep_us(rng_below(100000));
 
 	//Main process loop
 	while (!terminating) {
 
+		// Stop if our oss is gone; its IPC objects are being torn down
+		if (getppid() != sharedState->ownerPid) {
+			break;
+		}
+
 		// Count resources currently held
 		total_held = 0;
 		for (int i = 0; i < NUM_RESOURCES; i++) {
@@ -187,7 +678,7 @@ int main(int argc, char *argv[]) {
 
 		// Check if we should terminate normally
 		if (total_requests >= 5 && total_held == 0) {
-			if (rand() % 100 < 25) { // 25% chance to terminate when holding no resources
+			if (rng_below(100) < workload.terminatePct) { // chance to terminate when holding no resources
 				if (send_message(TERMINATE, 0)) {
 					break;  // Normal termination
 				}
@@ -195,33 +686,60 @@ int main(int argc, char *argv[]) {
 		}
 
 		// Main resource management
-		if (total_requests < MAX_REQUESTS) {
-			if (total_held == 0 || (total_held < MAX_RESOURCES_PER_PROCESS && rand() % 100 < 75)) {
+		int bundle[NUM_RESOURCES];
+		if (total_requests < workload.maxRequests && total_held == 0 && rng_below(100) < workload.bundlePct &&
+				pick_claimed_bundle(myResources, bundle)) {
+			// Take several instances at once: all or nothing, so we never hold some while waiting for the rest
+			total_requests++;
+			if (send_vector_message(REQUEST_VECTOR, 0, bundle)) {
+				for (int i = 0; i < NUM_RESOURCES; i++) {
+					myResources[i] += bundle[i];
+				}
+				consecutive_denials = 0;
+				operations_since_last_release++;
+				pace_sleep_us(sample_hold_us());
+			} else {
+				consecutive_denials++;
+				pace_sleep_us(rng_below(500000) * (consecutive_denials + 1));
+			}
+		} else if (total_requests < workload.maxRequests) {
+			if (total_held == 0 || (total_held < workload.maxHeld && rng_below(100) < workload.requestPct)) {
 				// Request a resource
-				int resourceId = rand() % NUM_RESOURCES;
-				if (total_held >= MAX_RESOURCES_PER_PROCESS || myResources[resourceId] >= 2) {
+				int resourceId = pick_claimed_resource(myResources);
+				if (total_held >= workload.maxHeld || resourceId == -1) {
 					// Skip request and maybe try to release instead
 					continue;
 				}
+				// Possibly several instances of it at once
+				int count = 1;
+				int most = myClaim[resourceId] - myResources[resourceId];
+				if (most > workload.maxMulti) most = workload.maxMulti;
+				if (most > workload.maxHeld - total_held) most = workload.maxHeld - total_held;
+				if (most > 1) count = 1 + rng_below(most);
+				int counts[NUM_RESOURCES] = {0};
+				counts[resourceId] = count;
+
 				total_requests++;
-				if (send_message(REQUEST_RESOURCE, resourceId)) {
-					myResources[resourceId]++;
-					total_held++;
+				if (claim_from_lease(resourceId, count) ||
+						(count == 1 ? send_message(REQUEST_RESOURCE, resourceId) :
+						send_vector_message(REQUEST_VECTOR, 0, counts))) {
+					myResources[resourceId] += count;
+					total_held += count;
 					consecutive_denials = 0;
 					operations_since_last_release++;
 					
 					// Hold the resource for a while
-					usleep(rand() % 500000 + 100000);
+					pace_sleep_us(sample_hold_us());
 				} else {
 					consecutive_denials++;
 					// Wait after denial, increasing wait time with consecutive denials
-					usleep((rand() % 500000) * (consecutive_denials + 1));
+					pace_sleep_us(rng_below(500000) * (consecutive_denials + 1));
 				}
-			} else if (operations_since_last_release >= 3 || total_held == MAX_RESOURCES_PER_PROCESS) {
+			} else if (operations_since_last_release >= 3 || total_held >= workload.maxHeld) {
 				// Release a resource after some operations or when at max
 				int resourceId;
 				do {
-					resourceId = rand() % NUM_RESOURCES;
+					resourceId = rng_below(NUM_RESOURCES);
 				} while (myResources[resourceId] == 0);
 
 				if (send_message(RELEASE_RESOURCE, resourceId)) {
@@ -231,21 +749,20 @@ int main(int argc, char *argv[]) {
 				}
 			}
 		} else if (total_held > 0) {
-			// Release all resources if we've hit max requests
-			for (int i = 0; i < NUM_RESOURCES; i++) {
-				while (myResources[i] > 0) {
-					if (send_message(RELEASE_RESOURCE, i)) {
-						myResources[i]--;
-						total_held--;
-						usleep(10000); // Small delay between releases
-					}
-		
+			// Release all resources if we've hit max requests, in one message
+			int held[NUM_RESOURCES];
+			memcpy(held, myResources, sizeof(held));
+			if (send_vector_message(RELEASE_VECTOR, 0, held)) {
+				for (int i = 0; i < NUM_RESOURCES; i++) {
+					myResources[i] -= held[i];
+					if (myResources[i] < 0) myResources[i] = 0; //a preemption may have beaten us to it
 				}
+				total_held = 0;
 			}
 		}
 
 		// Delay between operations
-		usleep(rand() % bound_B + 50000);
+		pace_sleep_us(sample_gap_us(bound_B));
 	}
 	
 	// Final cleanup if terminated by signal